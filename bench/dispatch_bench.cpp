@@ -0,0 +1,68 @@
+// Threads logging to one shared logger: measures what Logger::Log costs per
+// event when the appenders do nothing, i.e. the dispatch to the appender list,
+// and what a log statement costs before it reaches Logger::Log.
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "logger.h"
+using namespace xac;
+
+class NullAppender : public LogAppenderBase {
+ private:
+  void Log(LogLevel::Level, const LogEvent &) override {}
+};
+
+auto main() -> int {
+  constexpr int kEventsPerThread = 2000000;
+  auto logger = std::make_shared<Logger>("dispatch");
+  logger->AddAppender(std::make_shared<NullAppender>());
+  logger->AddAppender(std::make_shared<NullAppender>());
+  static constexpr LogSite site{__FILE__, __LINE__, nullptr};
+  unsigned max_threads = std::max(8u, std::thread::hardware_concurrency());
+  for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; t++) {
+      workers.emplace_back([&]() {
+        LogEvent event(site, GetTimeNs(), 0, GetThreadId(), GetThreadName(), GetFiberId(), logger->GetName(),
+                       LogLevel::Level::INFO);
+        for (int i = 0; i < kEventsPerThread; i++) {
+          logger->Log(event);
+        }
+      });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    auto cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << threads << " threads: " << static_cast<int>(threads * kEventsPerThread / cost / 1e6)
+              << " M events/s" << std::endl;
+  }
+
+  // a statement below the logger's level: finding the logger and checking the level
+  LoggerManager::Instance();
+  LoggerManager::GetInstance()->AddLogger(logger);
+  auto info_appender = std::make_shared<NullAppender>();
+  info_appender->SetLevel(LogLevel::Level::INFO);
+  logger->ClearAppenders();
+  logger->AddAppender(info_appender);
+  for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; t++) {
+      workers.emplace_back([&]() {
+        for (int i = 0; i < kEventsPerThread; i++) {
+          LDEBUG("dispatch") << i;
+        }
+      });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    auto cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << threads << " threads, disabled statement: " << static_cast<int>(threads * kEventsPerThread / cost / 1e6)
+              << " M statements/s" << std::endl;
+  }
+  return 0;
+}
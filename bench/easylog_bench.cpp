@@ -0,0 +1,196 @@
+// End-to-end cost of a log statement: for every appender mode, every macro
+// family and 1 to N threads, the distribution of the time one statement takes
+// on the calling thread (p50, p99, p99.9, max) and the aggregate throughput.
+// A latency includes the two steady_clock reads around the statement.
+// Throughput is measured in a separate untimed run and counts two rates: the
+// calls the threads complete, and the events written once the appender has
+// drained its queue. Prints one JSON object per run, e.g. for a CSV:
+//   easylog_bench | jq -r '[.mode, .macro, .threads, .p99_ns] | @csv'
+// Usage: easylog_bench [events per thread] [max threads] [mode or macro filter]
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logger.h"
+using namespace xac;
+
+namespace {
+
+class NullAppender : public LogAppenderBase {
+ private:
+  void Log(LogLevel::Level, const LogEvent &) override {}
+};
+
+constexpr char kFileName[] = "easylog_bench.log";
+
+struct Mode {
+  const char *name;
+  std::function<LogAppenderBase::SharedPtr()> make;
+};
+
+const Mode kModes[] = {
+    {"null", []() { return std::make_shared<NullAppender>(); }},
+    {"console", []() { return std::make_shared<ConsoleLogAppender>(); }},
+    {"console_async", []() { return std::make_shared<ConsoleLogAppender>(true); }},
+    {"file_sync", []() { return std::make_shared<FileLogAppender>(kFileName); }},
+    {"file_ring_buffer",
+     []() { return std::make_shared<FileLogAppender>(kFileName, FileLogAppender::AsyncMode::RING_BUFFER); }},
+    {"file_block_deque",
+     []() { return std::make_shared<FileLogAppender>(kFileName, FileLogAppender::AsyncMode::BLOCK_DEQUE); }},
+    {"file_deferred",
+     []() { return std::make_shared<FileLogAppender>(kFileName, FileLogAppender::AsyncMode::DEFERRED); }},
+    {"file_binary", []() { return std::make_shared<FileLogAppender>(kFileName, FileLogAppender::AsyncMode::BINARY); }},
+};
+
+enum Macro { STREAM = 0, PRINTF = 1, BRACES = 2, DISABLED = 3 };
+const char *const kMacroNames[] = {"stream", "printf", "braces", "disabled"};
+
+template <int kMacro>
+inline void Statement(int i) {
+  if constexpr (kMacro == Macro::STREAM) {
+    LINFO("bench") << "request " << i << " took " << 1.5 << " ms";
+  } else if constexpr (kMacro == Macro::PRINTF) {
+    FLINFO("bench", "request %d took %g ms", i, 1.5);
+  } else if constexpr (kMacro == Macro::BRACES) {
+    FMTINFO("bench", "request {} took {} ms", i, 1.5);
+  } else {
+    LDEBUG("bench") << "request " << i << " took " << 1.5 << " ms";
+  }
+}
+
+struct Result {
+  double calls_per_sec = 0;
+  double drained_per_sec = 0;
+  std::vector<uint32_t> latencies;  // ns, empty for the untimed run
+};
+
+// `threads` threads run `events` statements each against a fresh appender
+template <int kMacro>
+Result Run(const Mode &mode, unsigned threads, int events, bool timed) {
+  auto logger = std::make_shared<Logger>("bench");
+  logger->SetLevel(LogLevel::Level::INFO);
+  auto appender = mode.make();
+  logger->AddAppender(appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+
+  std::vector<std::vector<uint32_t>> latencies(timed ? threads : 0);
+  std::atomic<unsigned> ready = 0;
+  std::atomic<bool> go = false;
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      // register the site and set up the thread's buffers before the clock starts
+      Statement<kMacro>(-1);
+      uint32_t *out = nullptr;
+      if (timed) {
+        latencies[t].resize(events);
+        out = latencies[t].data();
+      }
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      if (timed) {
+        for (int i = 0; i < events; i++) {
+          auto start = std::chrono::steady_clock::now();
+          Statement<kMacro>(i);
+          out[i] = static_cast<uint32_t>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+      } else {
+        for (int i = 0; i < events; i++) {
+          Statement<kMacro>(i);
+        }
+      }
+    });
+  }
+  while (ready.load() != threads) {
+    std::this_thread::yield();
+  }
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  auto called = std::chrono::steady_clock::now();
+  // the last reference: the appender drains its queue and closes the file
+  LoggerManager::GetInstance()->DeleteLogger("bench");
+  logger.reset();
+  appender.reset();
+  auto drained = std::chrono::steady_clock::now();
+
+  Result result;
+  double total = static_cast<double>(threads) * events;
+  result.calls_per_sec = total / std::chrono::duration<double>(called - start).count();
+  result.drained_per_sec = total / std::chrono::duration<double>(drained - start).count();
+  for (auto &thread_latencies : latencies) {
+    result.latencies.insert(result.latencies.end(), thread_latencies.begin(), thread_latencies.end());
+  }
+  std::remove(kFileName);
+  return result;
+}
+
+using RunFunction = Result (*)(const Mode &, unsigned, int, bool);
+const RunFunction kRuns[] = {Run<Macro::STREAM>, Run<Macro::PRINTF>, Run<Macro::BRACES>, Run<Macro::DISABLED>};
+
+uint32_t Percentile(const std::vector<uint32_t> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  auto index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+}  // namespace
+
+auto main(int argc, char **argv) -> int {
+  int events = argc > 1 ? std::atoi(argv[1]) : 50000;
+  unsigned max_threads = argc > 2 ? std::atoi(argv[2]) : std::max(4u, std::thread::hardware_concurrency());
+  const char *filter = argc > 3 ? argv[3] : nullptr;
+  if (events <= 0 || max_threads == 0) {
+    std::fprintf(stderr, "usage: %s [events per thread] [max threads] [mode or macro filter]\n", argv[0]);
+    return 1;
+  }
+  // the console appenders write to /dev/null, the results keep the real stdout
+  std::fflush(stdout);
+  FILE *results = fdopen(dup(STDOUT_FILENO), "w");
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (results == nullptr || null_fd == -1 || dup2(null_fd, STDOUT_FILENO) == -1) {
+    std::perror("easylog_bench");
+    return 1;
+  }
+  close(null_fd);
+  LoggerManager::Instance();
+
+  for (const auto &mode : kModes) {
+    for (int macro = 0; macro < 4; macro++) {
+      if (filter != nullptr && std::strstr(mode.name, filter) == nullptr &&
+          std::strstr(kMacroNames[macro], filter) == nullptr) {
+        continue;
+      }
+      for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        auto throughput = kRuns[macro](mode, threads, events, false);
+        auto latency = kRuns[macro](mode, threads, events, true);
+        auto &sorted = latency.latencies;
+        std::sort(sorted.begin(), sorted.end());
+        std::fprintf(results,
+                     "{\"mode\":\"%s\",\"macro\":\"%s\",\"threads\":%u,\"events\":%llu,\"calls_per_sec\":%.0f,"
+                     "\"drained_per_sec\":%.0f,\"p50_ns\":%u,\"p99_ns\":%u,\"p999_ns\":%u,\"max_ns\":%u}\n",
+                     mode.name, kMacroNames[macro], threads, static_cast<unsigned long long>(threads) * events,
+                     throughput.calls_per_sec, throughput.drained_per_sec, Percentile(sorted, 0.5),
+                     Percentile(sorted, 0.99), Percentile(sorted, 0.999), sorted.empty() ? 0 : sorted.back());
+        std::fflush(results);
+      }
+    }
+  }
+  std::fclose(results);
+  return 0;
+}
@@ -0,0 +1,112 @@
+// Compare the three ways of formatting an event: the virtual format items
+// writing to an ostream, the compiled instruction program writing to a
+// LineBuffer, and StaticFormatter with the program built at compile time.
+// Also the cost of stamping an event with each Clock source, and of printing a
+// message: vasprintf into the content stream, the way LogEvent::Format used to,
+// against captured printf-style and `{}` arguments, and of streaming into a
+// fresh std::stringstream, the way events used to, against LogStream.
+#include <chrono>
+#include <cstdarg>
+#include <iostream>
+#include "logger.h"
+using namespace xac;
+
+template <typename F>
+void Measure(const char *name, int iterations, F &&run) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    run();
+  }
+  auto cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  std::cout << name << ": " << cost / iterations << " ns/event" << std::endl;
+}
+
+// the old LogEvent::Format: vasprintf, then copy into the stream
+void VasprintfFormat(LogStream &os, const char *format, ...) {
+  va_list al;
+  va_start(al, format);
+  char *buf = nullptr;
+  int len = vasprintf(&buf, format, al);
+  va_end(al);
+  if (len != -1) {
+    os << std::string(buf, len);
+    free(buf);
+  }
+}
+
+auto main() -> int {
+  constexpr int kIterations = 1000000;
+  static constexpr LogSite site{__FILE__, __LINE__, nullptr};
+  std::string logger_name = "bench";
+  LogEvent event(site, GetTimeNs(), 0, 1234, GetThreadName(), 1, logger_name, LogLevel::Level::INFO);
+  event.GetStringStream() << "the quick brown fox jumps over the lazy dog " << 42;
+
+  const char *clock_names[] = {"REALTIME", "REALTIME_COARSE", "MONOTONIC", "TSC"};
+  for (auto source : {Clock::Source::REALTIME, Clock::Source::REALTIME_COARSE, Clock::Source::MONOTONIC,
+                      Clock::Source::TSC}) {
+    if (!Clock::SetSource(source)) {
+      continue;
+    }
+    std::string name = std::string("clock ") + clock_names[source];
+    volatile uint64_t sink = 0;
+    Measure(name.c_str(), kIterations, [&]() { sink = sink + Clock::Now(); });
+  }
+  Clock::SetSource(Clock::Source::REALTIME);
+
+  std::cout << "message" << std::endl;
+  static LogSite printf_site{__FILE__, __LINE__, "request %d served in %.2f ms by %s"};
+  static LogSite braces_site{__FILE__, __LINE__, "request {} served in {} ms by {}", nullptr,
+                             LogLevel::Level::INFO, true};
+  std::string worker = "worker";
+  LogEvent message(printf_site, GetTimeNs(), 0, 1234, GetThreadName(), 1, logger_name, LogLevel::Level::INFO);
+  Measure("  vasprintf", kIterations, [&]() {
+    message.Reset(printf_site, 0, 0, 1234, GetThreadName(), 1, logger_name, LogLevel::Level::INFO);
+    VasprintfFormat(message.GetStringStream(), printf_site.format, 42, 1.25, worker.c_str());
+    message.GetContent();
+  });
+  Measure("  printf capture", kIterations, [&]() {
+    message.Reset(printf_site, 0, 0, 1234, GetThreadName(), 1, logger_name, LogLevel::Level::INFO);
+    message.Capture(42, 1.25, worker);
+    message.GetContent();
+  });
+  Measure("  {} capture", kIterations, [&]() {
+    message.Reset(braces_site, 0, 0, 1234, GetThreadName(), 1, logger_name, LogLevel::Level::INFO);
+    message.CaptureBraces<3>(42, 1.25, worker);
+    message.GetContent();
+  });
+  volatile size_t content_size = 0;
+  Measure("  std::stringstream", kIterations, [&]() {
+    std::stringstream ss;
+    ss << "request " << 42 << " served in " << 1.25 << " ms by " << worker;
+    content_size = ss.str().size();
+  });
+  Measure("  LogStream", kIterations, [&]() {
+    message.Reset(printf_site, 0, 0, 1234, GetThreadName(), 1, logger_name, LogLevel::Level::INFO);
+    message.GetStringStream() << "request " << 42 << " served in " << 1.25 << " ms by " << worker;
+    content_size = message.GetContent().size();
+  });
+
+  for (const auto *pattern : {kSimplePattern, kComplexPattern}) {
+    std::cout << pattern << std::endl;
+    Formatter formatter(pattern);
+    LineBuffer line_buf;
+    std::ostream line_os(&line_buf);
+    Measure("  format items", kIterations, [&]() {
+      line_buf.Clear();
+      formatter.Format(line_os, LogLevel::Level::INFO, event);
+    });
+    Measure("  program", kIterations, [&]() {
+      line_buf.Clear();
+      formatter.Format(line_buf, LogLevel::Level::INFO, event);
+    });
+    Measure("  static program", kIterations, [&]() {
+      line_buf.Clear();
+      if (pattern == kSimplePattern) {
+        StaticFormatter<kSimplePattern>::Format(line_buf, LogLevel::Level::INFO, event);
+      } else {
+        StaticFormatter<kComplexPattern>::Format(line_buf, LogLevel::Level::INFO, event);
+      }
+    });
+  }
+  return 0;
+}
@@ -0,0 +1,331 @@
+#include "arg_pack.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace xac {
+namespace arg_pack {
+
+bool Next(std::string_view &args, Arg &arg) {
+  if (args.empty()) {
+    return false;
+  }
+  arg.type = static_cast<ArgType>(args[0]);
+  args.remove_prefix(1);
+  auto take = [&args](void *dst, size_t size) {
+    if (args.size() < size) {
+      args = {};
+      return false;
+    }
+    memcpy(dst, args.data(), size);
+    args.remove_prefix(size);
+    return true;
+  };
+  switch (arg.type) {
+    case ArgType::INT:
+      return take(&arg.i, sizeof(arg.i));
+    case ArgType::UINT:
+    case ArgType::POINTER:
+    case ArgType::BOOL:
+    case ArgType::CHAR:
+      return take(&arg.u, sizeof(arg.u));
+    case ArgType::DOUBLE:
+      return take(&arg.d, sizeof(arg.d));
+    case ArgType::STRING:
+      if (!take(&arg.len, sizeof(arg.len)) || args.size() < arg.len) {
+        args = {};
+        return false;
+      }
+      arg.str = args.data();
+      args.remove_prefix(arg.len);
+      return true;
+  }
+  args = {};
+  return false;
+}
+
+namespace {
+
+int64_t AsInt(const Arg &arg) {
+  switch (arg.type) {
+    case ArgType::INT:
+      return arg.i;
+    case ArgType::DOUBLE:
+      return static_cast<int64_t>(arg.d);
+    case ArgType::STRING:
+      return 0;
+    default:
+      return static_cast<int64_t>(arg.u);
+  }
+}
+
+double AsDouble(const Arg &arg) {
+  switch (arg.type) {
+    case ArgType::INT:
+      return static_cast<double>(arg.i);
+    case ArgType::DOUBLE:
+      return arg.d;
+    case ArgType::STRING:
+      return 0;
+    default:
+      return static_cast<double>(arg.u);
+  }
+}
+
+// a printf conversion spec built on the stack: "%", flags, width, precision, then the
+// length and conversion; 48 bytes hold six flags, a 20-digit width and an 11-digit precision
+class Spec {
+ public:
+  void Reset() {
+    buf_[0] = '%';
+    len_ = 1;
+  }
+  bool Plain() const { return len_ == 1; }
+  void Add(char c) {
+    if (len_ + 1 < sizeof(buf_)) {
+      buf_[len_++] = c;
+    }
+  }
+  void Add(int64_t value) {
+    auto result = std::to_chars(buf_ + len_, buf_ + sizeof(buf_) - 1, value);
+    if (result.ec == std::errc()) {
+      len_ = result.ptr - buf_;
+    }
+  }
+  // the spec followed by `suffix`, valid until the next call
+  const char *With(const char *suffix) {
+    size_t len = std::min(strlen(suffix), sizeof(buf_) - 1 - len_);
+    memcpy(buf_ + len_, suffix, len);
+    buf_[len_ + len] = '\0';
+    return buf_;
+  }
+
+ private:
+  char buf_[48];
+  size_t len_ = 0;
+};
+
+// snprintf one conversion into `out`, spilling to the heap only for very long output
+template <typename T>
+void PrintOne(std::streambuf &out, const char *spec, T value) {
+  char buf[128];
+  int len = snprintf(buf, sizeof(buf), spec, value);
+  if (len < 0) {
+    return;
+  }
+  if (static_cast<size_t>(len) < sizeof(buf)) {
+    out.sputn(buf, len);
+    return;
+  }
+  std::string big(len + 1, '\0');
+  snprintf(big.data(), big.size(), spec, value);
+  out.sputn(big.data(), len);
+}
+
+// a bare %d, %i, %u or %x, which need no snprintf
+template <typename T>
+void PrintPlain(std::streambuf &out, T value, int base) {
+  char buf[24];
+  auto result = std::to_chars(buf, buf + sizeof(buf), value, base);
+  out.sputn(buf, result.ptr - buf);
+}
+
+}  // namespace
+
+void PrintValue(std::streambuf &out, const Arg &arg) {
+  char buf[64];
+  std::to_chars_result result{buf, std::errc()};
+  switch (arg.type) {
+    case ArgType::INT:
+      result = std::to_chars(buf, buf + sizeof(buf), arg.i);
+      break;
+    case ArgType::UINT:
+      result = std::to_chars(buf, buf + sizeof(buf), arg.u);
+      break;
+    case ArgType::DOUBLE:
+      result = std::to_chars(buf, buf + sizeof(buf), arg.d);
+      break;
+    case ArgType::POINTER:
+      buf[0] = '0';
+      buf[1] = 'x';
+      result = std::to_chars(buf + 2, buf + sizeof(buf), arg.u, 16);
+      break;
+    case ArgType::BOOL:
+      out.sputn(arg.u != 0 ? "true" : "false", arg.u != 0 ? 4 : 5);
+      return;
+    case ArgType::CHAR:
+      out.sputc(static_cast<char>(arg.u));
+      return;
+    case ArgType::STRING:
+      out.sputn(arg.str, arg.len);
+      return;
+  }
+  out.sputn(buf, result.ptr - buf);
+}
+
+void FormatBraces(std::streambuf &out, const char *format, std::string_view args) {
+  const char *p = format;
+  while (*p != '\0') {
+    const char *literal = p;
+    while (*p != '\0' && *p != '{' && *p != '}') {
+      ++p;
+    }
+    out.sputn(literal, p - literal);
+    if (*p == '\0') {
+      break;
+    }
+    Arg arg;
+    if (p[0] == '{' && p[1] == '}' && Next(args, arg)) {
+      PrintValue(out, arg);
+    } else {
+      // `{{`, `}}`, or more placeholders than arguments
+      out.sputc(*p);
+      if (p[1] != *p && p[1] != '\0') {
+        out.sputc(p[1]);
+      }
+    }
+    p += p[1] != '\0' ? 2 : 1;
+  }
+}
+
+void FormatArgs(std::streambuf &out, const char *format, std::string_view args) {
+  Spec spec;
+  const char *p = format;
+  while (*p != '\0') {
+    const char *literal = p;
+    while (*p != '\0' && *p != '%') {
+      ++p;
+    }
+    out.sputn(literal, p - literal);
+    if (*p == '\0') {
+      break;
+    }
+    const char *start = p++;
+    if (*p == '%') {
+      out.sputc('%');
+      ++p;
+      continue;
+    }
+    // %[flags][width][.precision][length]conversion
+    spec.Reset();
+    while (*p != '\0' && strchr("-+ #0'", *p) != nullptr) {
+      spec.Add(*p++);
+    }
+    Arg arg;
+    if (*p == '*') {
+      ++p;
+      spec.Add(Next(args, arg) ? AsInt(arg) : 0);
+    }
+    while (*p >= '0' && *p <= '9') {
+      spec.Add(*p++);
+    }
+    int precision = -1;
+    if (*p == '.') {
+      ++p;
+      precision = 0;
+      if (*p == '*') {
+        ++p;
+        precision = Next(args, arg) ? static_cast<int>(AsInt(arg)) : 0;
+      }
+      while (*p >= '0' && *p <= '9') {
+        precision = precision * 10 + (*p++ - '0');
+      }
+    }
+    while (*p != '\0' && strchr("hlLqjzt", *p) != nullptr) {
+      ++p;
+    }
+    char conversion = *p;
+    if (conversion == '\0') {
+      out.sputn(start, p - start);
+      break;
+    }
+    ++p;
+    if (conversion == 'n') {
+      continue;
+    }
+    if (!Next(args, arg)) {
+      // more conversions than arguments, keep the conversion as written
+      out.sputn(start, p - start);
+      continue;
+    }
+    bool plain = spec.Plain() && precision < 0;
+    if (precision >= 0 && conversion != 's') {
+      spec.Add('.');
+      spec.Add(static_cast<int64_t>(precision));
+    }
+    const char ll_conversion[] = {'l', 'l', conversion, '\0'};
+    switch (conversion) {
+      case 'd':
+      case 'i':
+        if (plain) {
+          PrintPlain(out, AsInt(arg), 10);
+        } else {
+          PrintOne(out, spec.With(ll_conversion), static_cast<long long>(AsInt(arg)));
+        }
+        break;
+      case 'u':
+      case 'x':
+        if (plain) {
+          PrintPlain(out, static_cast<uint64_t>(AsInt(arg)), conversion == 'x' ? 16 : 10);
+          break;
+        }
+        [[fallthrough]];
+      case 'o':
+      case 'X':
+        PrintOne(out, spec.With(ll_conversion), static_cast<unsigned long long>(AsInt(arg)));
+        break;
+      case 'c':
+        PrintOne(out, spec.With(ll_conversion + 2), static_cast<int>(AsInt(arg)));
+        break;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A':
+        PrintOne(out, spec.With(ll_conversion + 2), AsDouble(arg));
+        break;
+      case 'p':
+        PrintOne(out, spec.With(ll_conversion + 2), reinterpret_cast<void *>(static_cast<uintptr_t>(AsInt(arg))));
+        break;
+      case 's': {
+        if (arg.type != ArgType::STRING) {
+          // not a string, print the value the way it was captured
+          if (arg.type == ArgType::DOUBLE) {
+            PrintOne(out, spec.With("g"), arg.d);
+          } else if (arg.type == ArgType::INT) {
+            PrintOne(out, spec.With("lld"), static_cast<long long>(arg.i));
+          } else {
+            PrintOne(out, spec.With("llu"), static_cast<unsigned long long>(arg.u));
+          }
+          break;
+        }
+        auto len = precision >= 0 ? std::min<uint32_t>(arg.len, precision) : arg.len;
+        if (spec.Plain()) {
+          out.sputn(arg.str, len);
+        } else {
+          const char *format_s = spec.With(".*s");
+          char buf[128];
+          int n = snprintf(buf, sizeof(buf), format_s, static_cast<int>(len), arg.str);
+          if (n >= 0 && static_cast<size_t>(n) < sizeof(buf)) {
+            out.sputn(buf, n);
+          } else if (n >= 0) {
+            std::string big(n + 1, '\0');
+            snprintf(big.data(), big.size(), format_s, static_cast<int>(len), arg.str);
+            out.sputn(big.data(), n);
+          }
+        }
+        break;
+      }
+      default:
+        out.sputn(start, p - start);
+    }
+  }
+}
+
+}  // namespace arg_pack
+}  // end namespace xac
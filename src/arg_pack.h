@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace xac {
+
+// Raw typed encoding of printf-style and `{}` arguments. Every argument is a one
+// byte tag followed by its value; strings are copied as a 32-bit length and
+// bytes. Capturing only copies bytes, `FormatArgs` or `FormatBraces` prints later.
+namespace arg_pack {
+
+enum ArgType : uint8_t {
+  INT = 0,      // int64_t
+  UINT = 1,     // uint64_t
+  DOUBLE = 2,   // double
+  STRING = 3,   // uint32_t length + bytes
+  POINTER = 4,  // uintptr_t
+  BOOL = 5,     // uint64_t
+  CHAR = 6,     // uint64_t
+};
+
+// Specialize to make a type loggable, e.g.
+//   template <> struct xac::arg_pack::ArgFormatter<Point> {
+//     static void Format(std::streambuf &out, const Point &p);
+//   };
+// Types with an operator<< work without one. Either way the text is captured as a string.
+template <typename T, typename = void>
+struct ArgFormatter {};
+
+template <typename T, typename = void>
+struct HasArgFormatter : std::false_type {};
+template <typename T>
+struct HasArgFormatter<
+    T, std::void_t<decltype(ArgFormatter<T>::Format(std::declval<std::streambuf &>(), std::declval<const T &>()))>>
+    : std::true_type {};
+
+template <typename T, typename = void>
+struct HasOstream : std::false_type {};
+template <typename T>
+struct HasOstream<T, std::void_t<decltype(std::declval<std::ostream &>() << std::declval<const T &>())>>
+    : std::true_type {};
+
+// Appends to a string that keeps its capacity, for printing user types
+class StringSink : public std::streambuf {
+ public:
+  std::string text;
+
+ protected:
+  int_type overflow(int_type ch) override {
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+      text += traits_type::to_char_type(ch);
+    }
+    return traits_type::not_eof(ch);
+  }
+  std::streamsize xsputn(const char *data, std::streamsize len) override {
+    text.append(data, static_cast<size_t>(len));
+    return len;
+  }
+};
+
+inline void Put(std::streambuf &out, ArgType type, const void *value, size_t size) {
+  auto tag = static_cast<char>(type);
+  out.sputc(tag);
+  out.sputn(static_cast<const char *>(value), static_cast<std::streamsize>(size));
+}
+
+inline void PutString(std::streambuf &out, const char *str, size_t len) {
+  auto len32 = static_cast<uint32_t>(len);
+  Put(out, ArgType::STRING, &len32, sizeof(len32));
+  out.sputn(str, static_cast<std::streamsize>(len));
+}
+
+inline void Encode(std::streambuf &out, const char *str) {
+  if (str == nullptr) {
+    str = "(null)";
+  }
+  PutString(out, str, strlen(str));
+}
+inline void Encode(std::streambuf &out, char *str) { Encode(out, static_cast<const char *>(str)); }
+inline void Encode(std::streambuf &out, const std::string &str) { PutString(out, str.data(), str.size()); }
+inline void Encode(std::streambuf &out, std::string_view str) { PutString(out, str.data(), str.size()); }
+
+template <typename T>
+void Encode(std::streambuf &out, const T &value) {
+  if constexpr (HasArgFormatter<T>::value || (HasOstream<T>::value && std::is_class_v<T>)) {
+    thread_local StringSink sink;
+    sink.text.clear();
+    if constexpr (HasArgFormatter<T>::value) {
+      ArgFormatter<T>::Format(sink, value);
+    } else {
+      std::ostream os(&sink);
+      os << value;
+    }
+    PutString(out, sink.text.data(), sink.text.size());
+  } else if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, char>) {
+    auto v = static_cast<uint64_t>(static_cast<unsigned char>(value));
+    Put(out, std::is_same_v<T, bool> ? ArgType::BOOL : ArgType::CHAR, &v, sizeof(v));
+  } else if constexpr (std::is_enum_v<T>) {
+    Encode(out, static_cast<std::underlying_type_t<T>>(value));
+  } else if constexpr (std::is_floating_point_v<T>) {
+    auto v = static_cast<double>(value);
+    Put(out, ArgType::DOUBLE, &v, sizeof(v));
+  } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+    auto v = static_cast<int64_t>(value);
+    Put(out, ArgType::INT, &v, sizeof(v));
+  } else if constexpr (std::is_integral_v<T>) {
+    auto v = static_cast<uint64_t>(value);
+    Put(out, ArgType::UINT, &v, sizeof(v));
+  } else if constexpr (std::is_pointer_v<T>) {
+    auto v = reinterpret_cast<uintptr_t>(value);
+    Put(out, ArgType::POINTER, &v, sizeof(v));
+  } else {
+    static_assert(std::is_pointer_v<T>, "argument type can not be captured, specialize arg_pack::ArgFormatter for it");
+  }
+}
+
+// One decoded argument, `str`/`len` point into the encoded bytes
+struct Arg {
+  ArgType type;
+  int64_t i;
+  uint64_t u;  // UINT, POINTER, BOOL and CHAR
+  double d;
+  const char *str;
+  uint32_t len;
+};
+
+// Decode the first argument of `args` and drop it, false when `args` is exhausted or corrupt.
+bool Next(std::string_view &args, Arg &arg);
+
+// Print `format` with the arguments encoded in `args` into `out`.
+void FormatArgs(std::streambuf &out, const char *format, std::string_view args);
+
+// Number of `{}` in `format`, -1 if a brace is not part of `{}`, `{{` or `}}`.
+constexpr int CountPlaceholders(const char *format) {
+  int count = 0;
+  for (; *format != '\0'; ++format) {
+    if (*format == '{' && format[1] == '}') {
+      ++count;
+      ++format;
+    } else if ((*format == '{' || *format == '}') && format[1] == *format) {
+      ++format;
+    } else if (*format == '{' || *format == '}') {
+      return -1;
+    }
+  }
+  return count;
+}
+
+// Print one argument the way `{}` does.
+void PrintValue(std::streambuf &out, const Arg &arg);
+
+// Print `format` with each `{}` replaced by the next argument in `args`, by its type.
+void FormatBraces(std::streambuf &out, const char *format, std::string_view args);
+
+}  // namespace arg_pack
+
+}  // end namespace xac
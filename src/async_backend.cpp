@@ -0,0 +1,298 @@
+#include "async_backend.h"
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <chrono>
+
+namespace xac {
+
+std::atomic<AsyncBackend *> AsyncBackend::running_ = nullptr;
+
+AsyncBackend &AsyncBackend::Get() {
+  static AsyncBackend backend;
+  return backend;
+}
+
+AsyncBackend::AsyncBackend() {
+  StartWorkers();
+  running_.store(this, std::memory_order_release);
+}
+
+AsyncBackend::~AsyncBackend() {
+  // the workers drain the rings before they stop
+  StopWorkers();
+  running_.store(nullptr, std::memory_order_release);
+}
+
+void AsyncBackend::Configure(const Options &options) {
+  std::lock_guard configure_guard(configure_mutex_);
+  StopWorkers();
+  {
+    std::lock_guard guard(mutex_);
+    options_ = options;
+    options_.workers = std::max(1u, options_.workers);
+  }
+  StartWorkers();
+}
+
+auto AsyncBackend::GetOptions() -> Options {
+  std::lock_guard guard(mutex_);
+  return options_;
+}
+
+void AsyncBackend::StartWorkers() {
+  std::lock_guard guard(mutex_);
+  stop_ = false;
+  unsigned workers = options_.workers;
+  running_workers_.store(workers, std::memory_order_relaxed);
+  for (unsigned worker = 0; worker < workers; worker++) {
+    workers_.emplace_back([this, worker, workers]() { Run(worker, workers); });
+    if (!options_.cpus.empty()) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(options_.cpus[worker % options_.cpus.size()], &cpus);
+      pthread_setaffinity_np(workers_.back().native_handle(), sizeof(cpus), &cpus);
+    }
+  }
+}
+
+void AsyncBackend::StopWorkers() {
+  {
+    std::lock_guard guard(mutex_);
+    stop_ = true;
+    ++wakeups_;
+  }
+  cond_backend_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+}
+
+AsyncBackend::QueueHandle::~QueueHandle() {
+  for (const auto &queue : queues) {
+    if (queue) {
+      queue->retired.store(true, std::memory_order_release);
+    }
+  }
+}
+
+auto AsyncBackend::LocalQueue(unsigned slot) -> ThreadQueue & {
+  thread_local QueueHandle handle;
+  if (handle.queues.size() <= slot) {
+    handle.queues.resize(slot + 1);
+  }
+  auto &queue = handle.queues[slot];
+  if (!queue) {
+    std::lock_guard guard(mutex_);
+    queue = std::make_shared<ThreadQueue>(kDefaultQueueCapacity, slot);
+    if (BeginQueuesChange()) {
+      queues_.push_back(queue);
+      EndQueuesChange();
+    }
+  }
+  return *queue;
+}
+
+auto AsyncBackend::Push(AsyncSink *sink, uint64_t stamp, std::initializer_list<std::string_view> parts) -> bool {
+  size_t len = 0;
+  for (const auto &part : parts) {
+    len += part.size();
+  }
+  if (!Fits(len)) {
+    return false;
+  }
+  while (!TryPush(sink, stamp, parts)) {
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+auto AsyncBackend::TryPush(AsyncSink *sink, uint64_t stamp, std::initializer_list<std::string_view> parts) -> bool {
+  size_t len = 0;
+  for (const auto &part : parts) {
+    len += part.size();
+  }
+  if (!Fits(len)) {
+    return false;
+  }
+  auto &ring = LocalQueue(sink->sink_id_ % running_workers_.load(std::memory_order_relaxed)).ring;
+  char *slot = ring.Reserve(kRecordHeader + len);
+  if (slot == nullptr) {
+    return false;
+  }
+  memcpy(slot, &sink, sizeof(sink));
+  memcpy(slot + sizeof(sink), &stamp, sizeof(stamp));
+  size_t offset = kRecordHeader;
+  for (const auto &part : parts) {
+    memcpy(slot + offset, part.data(), part.size());
+    offset += part.size();
+  }
+  ring.Commit(kRecordHeader + len);
+  return true;
+}
+
+void AsyncBackend::Flush() { Flush(std::chrono::steady_clock::time_point::max()); }
+
+auto AsyncBackend::Flush(std::chrono::steady_clock::time_point deadline) -> bool {
+  // every ring must be consumed up to where it is now, and the batch that did it ended
+  std::vector<std::pair<std::shared_ptr<ThreadQueue>, size_t>> targets;
+  std::unique_lock lock(mutex_);
+  for (const auto &queue : queues_) {
+    targets.emplace_back(queue, queue->ring.WritePosition());
+  }
+  ++wakeups_;
+  cond_backend_.notify_all();
+  auto done = [&]() {
+    return std::all_of(targets.begin(), targets.end(), [](const auto &target) {
+      return target.first->done_position.load(std::memory_order_acquire) >= target.second;
+    });
+  };
+  if (deadline == std::chrono::steady_clock::time_point::max()) {
+    cond_flush_.wait(lock, done);
+    return true;
+  }
+  return cond_flush_.wait_until(lock, deadline, done);
+}
+
+auto AsyncBackend::BeginQueuesChange() -> bool {
+  queues_changing_.store(true, std::memory_order_seq_cst);
+  if (crash_draining_.load(std::memory_order_seq_cst)) {
+    queues_changing_.store(false, std::memory_order_seq_cst);
+    return false;
+  }
+  return true;
+}
+
+void AsyncBackend::CrashDrain() {
+  // no mutex in a signal handler; the crash may have hit a thread changing queues_
+  crash_draining_.store(true, std::memory_order_seq_cst);
+  if (queues_changing_.load(std::memory_order_seq_cst)) {
+    return;
+  }
+  for (const auto &queue : queues_) {
+    // a worker may be consuming the front record; once held here, no worker takes the ring
+    if (queue->held.exchange(true, std::memory_order_acquire)) {
+      continue;
+    }
+    queue->ring.Peek([](const char *record, size_t len) {
+      AsyncSink *sink;
+      memcpy(&sink, record, sizeof(sink));
+      sink->CrashConsume(record + kRecordHeader, len - kRecordHeader);
+    });
+  }
+}
+
+auto AsyncBackend::DrainOnce(unsigned worker, unsigned workers) -> size_t {
+  std::vector<std::shared_ptr<ThreadQueue>> queues;
+  {
+    std::lock_guard guard(mutex_);
+    queues = queues_;
+  }
+  struct Held {
+    ThreadQueue *queue;
+    bool empty;
+  };
+  thread_local std::vector<Held> held;
+  held.clear();
+  // stop after the bytes there are now, so busy producers cannot keep one pass going forever
+  size_t budget = 0;
+  for (const auto &queue : queues) {
+    if (queue->slot % workers == worker && !queue->held.exchange(true, std::memory_order_acquire)) {
+      held.push_back({queue.get(), false});
+      budget += queue->ring.WritePosition() - queue->ring.ReadPosition();
+    }
+  }
+
+  thread_local std::vector<AsyncSink *> batch_sinks;
+  size_t consumed = 0;
+  size_t drained = 0;
+  while (drained < budget) {
+    // the oldest front record among the rings; a ring that was empty is looked at again once
+    // it is known, a record pushed to it meanwhile may be older
+    Held *next = nullptr;
+    const char *next_record = nullptr;
+    size_t next_len = 0;
+    uint64_t next_stamp = 0;
+    bool rescan = true;
+    while (rescan) {
+      next = nullptr;
+      for (auto &it : held) {
+        size_t len;
+        const char *record = it.queue->ring.Front(len);
+        it.empty = record == nullptr;
+        if (it.empty) {
+          continue;
+        }
+        uint64_t stamp;
+        memcpy(&stamp, record + sizeof(AsyncSink *), sizeof(stamp));
+        if (next == nullptr || stamp < next_stamp) {
+          next = &it;
+          next_record = record;
+          next_len = len;
+          next_stamp = stamp;
+        }
+      }
+      rescan = next != nullptr && std::any_of(held.begin(), held.end(), [](const Held &it) {
+                 return it.empty && !it.queue->ring.Empty();
+               });
+    }
+    if (next == nullptr) {
+      break;
+    }
+    AsyncSink *sink;
+    memcpy(&sink, next_record, sizeof(sink));
+    sink->Consume(next_record + kRecordHeader, next_len - kRecordHeader);
+    if (std::find(batch_sinks.begin(), batch_sinks.end(), sink) == batch_sinks.end()) {
+      batch_sinks.push_back(sink);
+    }
+    auto read = next->queue->ring.ReadPosition();
+    next->queue->ring.Pop();
+    drained += next->queue->ring.ReadPosition() - read;
+    ++consumed;
+  }
+  for (auto *sink : batch_sinks) {
+    sink->EndBatch();
+  }
+  batch_sinks.clear();
+
+  for (auto &it : held) {
+    it.queue->done_position.store(it.queue->ring.ReadPosition(), std::memory_order_release);
+    it.queue->held.store(false, std::memory_order_release);
+  }
+  std::lock_guard guard(mutex_);
+  for (const auto &queue : queues) {
+    if (queue->slot % workers == worker && queue->retired.load(std::memory_order_acquire) && queue->ring.Empty() &&
+        BeginQueuesChange()) {
+      queues_.erase(std::remove(queues_.begin(), queues_.end(), queue), queues_.end());
+      EndQueuesChange();
+    }
+  }
+  cond_flush_.notify_all();
+  return consumed;
+}
+
+void AsyncBackend::Run(unsigned worker, unsigned workers) {
+  uint64_t seen = 0;
+  while (true) {
+    bool stopping;
+    {
+      std::lock_guard guard(mutex_);
+      stopping = stop_;
+    }
+    // on the way out each worker drains its rings until they are empty
+    auto consumed = DrainOnce(worker, workers);
+    std::unique_lock lock(mutex_);
+    if (consumed == 0) {
+      if (stop_ && stopping) {
+        break;
+      }
+      if (seen == wakeups_) {
+        cond_backend_.wait_for(lock, std::chrono::milliseconds(1), [&]() { return seen != wakeups_ || stop_; });
+      }
+    }
+    seen = wakeups_;
+  }
+}
+
+}  // end namespace xac
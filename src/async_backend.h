@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "ring_buffer.h"
+
+namespace xac {
+
+// Receiver of records pushed through the AsyncBackend. The calls happen on
+// the sink's backend worker, one at a time.
+class AsyncSink {
+ public:
+  AsyncSink() : sink_id_(next_sink_id_.fetch_add(1, std::memory_order_relaxed)) {}
+  virtual ~AsyncSink() = default;
+  // consume one record that was pushed to this sink
+  virtual void Consume(const char *data, size_t len) = 0;
+  // called once per drain pass for every sink that consumed records in it
+  virtual void EndBatch() {}
+  // from a crash handler, on the crashing thread: write a record that was not
+  // consumed yet with raw write(2), without locks or allocation
+  virtual void CrashConsume(const char *, size_t) {}
+
+ private:
+  friend class AsyncBackend;
+  const uint64_t sink_id_;  // creation order, picks the worker
+  static inline std::atomic<uint64_t> next_sink_id_ = 0;
+};
+
+// A pool of backend workers draining lock-free SPSC rings, one per producer
+// thread and worker. Each sink belongs to one worker, and a producer pushes a
+// record to its ring for the worker of the record's sink; it registers that
+// ring the first time, the ring is retired when the thread exits and released
+// once it is drained. A worker merges all of its rings by the records' stamps,
+// ties going to the earlier registered ring, so a sink sees its records in
+// time order, as far as the producers pushed them in that order.
+class AsyncBackend {
+ public:
+  static constexpr size_t kDefaultQueueCapacity = 1 << 18;
+  struct Options {
+    unsigned workers = 1;
+    std::vector<int> cpus;  // pin the workers to these CPUs, round robin; empty leaves them unpinned
+  };
+
+  static AsyncBackend &Get();
+  // the backend if it was started and is not destroyed yet, else nullptr
+  static AsyncBackend *Running() { return running_.load(std::memory_order_acquire); }
+  AsyncBackend(const AsyncBackend &) = delete;
+  AsyncBackend &operator=(const AsyncBackend &) = delete;
+  ~AsyncBackend();
+
+  // restart the workers with `options`, the running ones drain the rings first
+  void Configure(const Options &options);
+  Options GetOptions();
+  // whether a record of `len` bytes fits a ring, larger ones are refused rather than cut
+  static bool Fits(size_t len) { return len <= kMaxRecordSize; }
+  // copy a record for `sink` into the calling thread's ring for the sink's worker, waits while the ring is full;
+  // `stamp` orders records from different threads, e.g. a Clock stamp. False if it does not fit
+  bool Push(AsyncSink *sink, uint64_t stamp, const char *data, size_t len) {
+    return Push(sink, stamp, {std::string_view(data, len)});
+  }
+  // same, the record is the concatenation of `parts`
+  bool Push(AsyncSink *sink, uint64_t stamp, std::initializer_list<std::string_view> parts);
+  // same without waiting, false when the ring is full or the record does not fit
+  bool TryPush(AsyncSink *sink, uint64_t stamp, std::initializer_list<std::string_view> parts);
+  // block until everything pushed before this call has been consumed
+  void Flush();
+  // same, giving up at `deadline`; false if it did
+  bool Flush(std::chrono::steady_clock::time_point deadline);
+  // async-signal-safe: hand the records not consumed yet to their sinks' CrashConsume;
+  // the rings a worker is draining at the time are skipped, their front record may be half written
+  void CrashDrain();
+
+ private:
+  static constexpr size_t kRecordHeader = sizeof(AsyncSink *) + sizeof(uint64_t);  // sink, stamp
+  static_assert((kDefaultQueueCapacity & (kDefaultQueueCapacity - 1)) == 0, "the ring keeps the capacity as is");
+  static constexpr size_t kMaxRecordSize = kDefaultQueueCapacity / 2 - SpscRingBuffer::kHeaderSize - kRecordHeader;
+  struct ThreadQueue {
+    ThreadQueue(size_t capacity, unsigned slot) : ring(capacity), slot(slot) {}
+    SpscRingBuffer ring;
+    const unsigned slot;  // worker `slot % workers` drains it
+    std::atomic<bool> retired{false};
+    std::atomic<bool> held{false};        // a worker is draining it
+    std::atomic<size_t> done_position{0};  // read position up to which the sinks have ended their batch
+  };
+  struct QueueHandle {
+    std::vector<std::shared_ptr<ThreadQueue>> queues;  // by slot
+    ~QueueHandle();
+  };
+
+  AsyncBackend();
+  ThreadQueue &LocalQueue(unsigned slot);
+  // one pass of `worker` out of `workers` over its rings; returns the records consumed
+  size_t DrainOnce(unsigned worker, unsigned workers);
+  void Run(unsigned worker, unsigned workers);
+  void StartWorkers();
+  void StopWorkers();
+  // with mutex_ held: false, and queues_ must stay as it is, once CrashDrain has started
+  bool BeginQueuesChange();
+  void EndQueuesChange() { queues_changing_.store(false, std::memory_order_seq_cst); }
+
+  std::mutex mutex_;  // guards queues_, the options and the wakeup state
+  std::vector<std::shared_ptr<ThreadQueue>> queues_;  // in registration order
+  // CrashDrain reads queues_ without the mutex: it does not while queues_ changes, and once it
+  // started, queues_ no longer changes
+  std::atomic<bool> queues_changing_ = false;
+  std::atomic<bool> crash_draining_ = false;
+  std::atomic<unsigned> running_workers_ = 1;  // picks the ring slot of a sink
+  Options options_;
+  std::condition_variable cond_backend_;
+  std::condition_variable cond_flush_;
+  uint64_t wakeups_ = 0;  // bumped to wake every worker
+  bool stop_ = false;
+  std::mutex configure_mutex_;  // serializes Configure
+  std::vector<std::thread> workers_;
+  static std::atomic<AsyncBackend *> running_;
+};
+
+}  // end namespace xac
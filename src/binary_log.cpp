@@ -0,0 +1,354 @@
+#include "binary_log.h"
+
+namespace xac {
+namespace binary_log {
+
+namespace {
+
+void PutVarint(std::streambuf &out, uint64_t value) {
+  char buf[10];
+  int len = 0;
+  do {
+    auto byte = static_cast<uint8_t>(value & 0x7f);
+    value >>= 7;
+    buf[len++] = static_cast<char>(value != 0 ? byte | 0x80 : byte);
+  } while (value != 0);
+  out.sputn(buf, len);
+}
+
+void PutString(std::streambuf &out, std::string_view str) {
+  PutVarint(out, str.size());
+  out.sputn(str.data(), static_cast<std::streamsize>(str.size()));
+}
+
+uint64_t ZigZag(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+
+int64_t UnZigZag(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+bool GetVarint(std::istream &in, uint64_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    auto ch = in.get();
+    if (ch == std::char_traits<char>::eof()) {
+      return false;
+    }
+    value |= static_cast<uint64_t>(ch & 0x7f) << shift;
+    if ((ch & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GetString(std::istream &in, std::string &str) {
+  uint64_t len;
+  if (!GetVarint(in, len) || len > (1u << 30)) {
+    return false;
+  }
+  str.resize(len);
+  return static_cast<bool>(in.read(str.data(), static_cast<std::streamsize>(len)));
+}
+
+// the arg_pack types of `args`, one byte per argument
+void ArgTypes(std::string_view args, std::string &types) {
+  types.clear();
+  arg_pack::Arg arg;
+  while (arg_pack::Next(args, arg)) {
+    types += static_cast<char>(arg.type);
+  }
+}
+
+// arg_pack arguments with varint integers, after their count and types unless the reader knows them
+void PutArgs(std::streambuf &out, std::string_view args, bool with_types = true) {
+  arg_pack::Arg arg;
+  if (with_types) {
+    uint64_t count = 0;
+    for (auto rest = args; arg_pack::Next(rest, arg);) {
+      ++count;
+    }
+    PutVarint(out, count);
+    for (auto rest = args; arg_pack::Next(rest, arg);) {
+      out.sputc(static_cast<char>(arg.type));
+    }
+  }
+  while (arg_pack::Next(args, arg)) {
+    switch (arg.type) {
+      case arg_pack::ArgType::INT:
+        PutVarint(out, ZigZag(arg.i));
+        break;
+      case arg_pack::ArgType::DOUBLE:
+        out.sputn(reinterpret_cast<const char *>(&arg.d), sizeof(arg.d));
+        break;
+      case arg_pack::ArgType::STRING:
+        PutString(out, std::string_view(arg.str, arg.len));
+        break;
+      default:
+        PutVarint(out, arg.u);
+    }
+  }
+}
+
+// read what PutArgs wrote back into the arg_pack encoding; `types` are the known ones,
+// or are set to the ones read
+bool GetArgs(std::istream &in, std::streambuf &out, std::string &str, std::string &types, bool with_types = true) {
+  if (with_types) {
+    uint64_t count;
+    if (!GetVarint(in, count) || count > (1u << 16)) {
+      return false;
+    }
+    types.clear();
+    for (uint64_t i = 0; i < count; i++) {
+      types += static_cast<char>(in.get());
+    }
+  }
+  for (char type_byte : types) {
+    auto type = static_cast<arg_pack::ArgType>(type_byte);
+    uint64_t value;
+    switch (type) {
+      case arg_pack::ArgType::INT: {
+        if (!GetVarint(in, value)) {
+          return false;
+        }
+        auto v = UnZigZag(value);
+        arg_pack::Put(out, type, &v, sizeof(v));
+        break;
+      }
+      case arg_pack::ArgType::DOUBLE: {
+        double v;
+        if (!in.read(reinterpret_cast<char *>(&v), sizeof(v))) {
+          return false;
+        }
+        arg_pack::Put(out, type, &v, sizeof(v));
+        break;
+      }
+      case arg_pack::ArgType::STRING:
+        if (!GetString(in, str)) {
+          return false;
+        }
+        arg_pack::PutString(out, str.data(), str.size());
+        break;
+      case arg_pack::ArgType::UINT:
+      case arg_pack::ArgType::POINTER:
+      case arg_pack::ArgType::BOOL:
+      case arg_pack::ArgType::CHAR:
+        if (!GetVarint(in, value)) {
+          return false;
+        }
+        arg_pack::Put(out, type, &value, sizeof(value));
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+// find the dictionary index of `key`, writing a new entry the first time
+template <typename Map, typename Key, typename WriteEntry>
+uint32_t Lookup(Map &map, const Key &key, WriteEntry write_entry) {
+  auto it = map.find(key);
+  if (it != map.end()) {
+    return it->second;
+  }
+  auto index = static_cast<uint32_t>(map.size());
+  map.emplace(key, index);
+  write_entry(index);
+  return index;
+}
+
+}  // namespace
+
+void Writer::Begin(std::streambuf &out, uint64_t time_base) {
+  out.sputn(kMagic, sizeof(kMagic));
+  out.sputn(reinterpret_cast<const char *>(&kVersion), sizeof(kVersion));
+  out.sputn(reinterpret_cast<const char *>(&time_base), sizeof(time_base));
+  last_time_ = time_base;
+  last_logger_ = UINT32_MAX;
+  last_thread_ = UINT32_MAX;
+  sites_.clear();
+  site_types_.clear();
+  loggers_.clear();
+  threads_.clear();
+}
+
+void Writer::Append(std::streambuf &out, const LogSite &site, const std::string &logger_name,
+                    const std::string &thread_name, uint64_t time, uint32_t thread_id, uint32_t fiber_id,
+                    LogLevel::Level level, bool has_args, std::string_view payload, std::string_view fields) {
+  auto site_index = Lookup(sites_, &site, [&](uint32_t index) {
+    out.sputc(Tag::SITE);
+    PutVarint(out, index);
+    PutVarint(out, site.line);
+    PutString(out, site.file_name);
+    out.sputc(site.format == nullptr ? 0 : site.braces ? 2 : 1);
+    PutString(out, site.format != nullptr ? site.format : "");
+    site_types_.emplace_back();
+  });
+  auto logger_index = Lookup(loggers_, &logger_name, [&](uint32_t index) {
+    out.sputc(Tag::LOGGER);
+    PutVarint(out, index);
+    PutString(out, logger_name);
+  });
+  thread_key_.assign(reinterpret_cast<const char *>(&thread_id), sizeof(thread_id));
+  thread_key_.append(reinterpret_cast<const char *>(&fiber_id), sizeof(fiber_id));
+  thread_key_ += thread_name;
+  auto thread_index = Lookup(threads_, thread_key_, [&](uint32_t index) {
+    out.sputc(Tag::THREAD);
+    PutVarint(out, index);
+    PutVarint(out, thread_id);
+    PutVarint(out, fiber_id);
+    PutString(out, thread_name);
+  });
+  bool new_source = logger_index != last_logger_ || thread_index != last_thread_;
+  bool same_types = false;
+  if (has_args) {
+    ArgTypes(payload, types_);
+    same_types = types_ == site_types_[site_index];
+    if (!same_types) {
+      site_types_[site_index] = types_;
+    }
+  }
+  out.sputc(static_cast<char>(Tag::RECORD | (has_args ? kRecordArgs : 0) | (!fields.empty() ? kRecordFields : 0) |
+                              (new_source ? kRecordSource : 0) | (same_types ? kRecordTypes : 0) |
+                              (level & kRecordLevel)));
+  PutVarint(out, site_index);
+  if (new_source) {
+    PutVarint(out, logger_index);
+    PutVarint(out, thread_index);
+    last_logger_ = logger_index;
+    last_thread_ = thread_index;
+  }
+  PutVarint(out, ZigZag(static_cast<int64_t>(time - last_time_)));
+  last_time_ = time;
+  if (has_args) {
+    PutArgs(out, payload, !same_types);
+  } else {
+    PutString(out, payload);
+  }
+  if (!fields.empty()) {
+    PutArgs(out, fields);
+  }
+}
+
+Reader::Reader(std::istream &in) : in_(in) { good_ = ReadHeader(); }
+
+auto Reader::ReadHeader() -> bool {
+  char magic[sizeof(kMagic)];
+  uint32_t version;
+  if (!in_.read(magic, sizeof(magic)) || std::string_view(magic, sizeof(magic)) != std::string_view(kMagic, 8) ||
+      !in_.read(reinterpret_cast<char *>(&version), sizeof(version)) || version != kVersion ||
+      !in_.read(reinterpret_cast<char *>(&time_base_), sizeof(time_base_))) {
+    return false;
+  }
+  last_time_ = time_base_;
+  last_logger_ = UINT64_MAX;
+  last_thread_ = UINT64_MAX;
+  sites_.clear();
+  site_types_.clear();
+  strings_.clear();
+  loggers_.clear();
+  threads_.clear();
+  return true;
+}
+
+auto Reader::Next() -> const LogEvent * {
+  if (!good_) {
+    return nullptr;
+  }
+  while (true) {
+    auto tag = in_.get();
+    // a file that was reopened continues with a new header
+    if (tag == kMagic[0]) {
+      in_.unget();
+      if (!ReadHeader()) {
+        return nullptr;
+      }
+      continue;
+    }
+    uint64_t index;
+    if (tag == std::char_traits<char>::eof() || !GetVarint(in_, index)) {
+      return nullptr;
+    }
+    if ((tag & Tag::RECORD) != 0) {
+      uint64_t delta;
+      if ((tag & kRecordSource) != 0 && (!GetVarint(in_, last_logger_) || !GetVarint(in_, last_thread_))) {
+        return nullptr;
+      }
+      if (!GetVarint(in_, delta)) {
+        return nullptr;
+      }
+      auto level = static_cast<LogLevel::Level>(tag & kRecordLevel);
+      bool has_args = (tag & kRecordArgs) != 0;
+      args_.Clear();
+      fields_.Clear();
+      if (index >= sites_.size() || last_logger_ >= loggers_.size() || last_thread_ >= threads_.size() ||
+          !(has_args ? GetArgs(in_, args_, payload_, site_types_[index], (tag & kRecordTypes) == 0)
+                     : GetString(in_, payload_)) ||
+          ((tag & kRecordFields) != 0 && !GetArgs(in_, fields_, field_str_, field_types_))) {
+        return nullptr;
+      }
+      last_time_ += UnZigZag(delta);
+      const auto &site = *sites_[index];
+      const auto &thread = *threads_[last_thread_];
+      const auto &logger_name = *loggers_[last_logger_];
+      auto elapse = last_time_ > time_base_ ? static_cast<uint32_t>((last_time_ - time_base_) / 1000000) : 0;
+      if (event_ == nullptr) {
+        event_ = std::make_unique<LogEvent>(site, last_time_, elapse, thread.thread_id, thread.name, thread.fiber_id,
+                                            logger_name, level);
+      } else {
+        event_->Reset(site, last_time_, elapse, thread.thread_id, thread.name, thread.fiber_id, logger_name, level);
+      }
+      if (has_args) {
+        event_->SetArgs(site.format != nullptr ? site.format : "", args_.View(), site.braces);
+      } else {
+        event_->GetStringStream() << payload_;
+      }
+      event_->SetFields(fields_.View());
+      return event_.get();
+    }
+    switch (tag) {
+      case Tag::SITE: {
+        uint64_t line;
+        auto &file_name = strings_.emplace_back();
+        auto &format = strings_.emplace_back();
+        if (!GetVarint(in_, line) || !GetString(in_, file_name)) {
+          return nullptr;
+        }
+        auto has_format = in_.get();
+        if (!GetString(in_, format) || index != sites_.size()) {
+          return nullptr;
+        }
+        sites_.emplace_back(
+            new LogSite{file_name.c_str(), static_cast<uint32_t>(line), has_format != 0 ? format.c_str() : nullptr,
+                        nullptr, LogLevel::Level::UNKNOWN, has_format == 2});
+        site_types_.emplace_back();
+        break;
+      }
+      case Tag::LOGGER: {
+        auto name = std::make_unique<std::string>();
+        if (!GetString(in_, *name) || index != loggers_.size()) {
+          return nullptr;
+        }
+        loggers_.push_back(std::move(name));
+        break;
+      }
+      case Tag::THREAD: {
+        uint64_t thread_id;
+        uint64_t fiber_id;
+        auto thread = std::make_unique<Thread>();
+        if (!GetVarint(in_, thread_id) || !GetVarint(in_, fiber_id) || !GetString(in_, thread->name) ||
+            index != threads_.size()) {
+          return nullptr;
+        }
+        thread->thread_id = static_cast<uint32_t>(thread_id);
+        thread->fiber_id = static_cast<uint32_t>(fiber_id);
+        threads_.push_back(std::move(thread));
+        break;
+      }
+      default:
+        return nullptr;
+    }
+  }
+}
+
+}  // namespace binary_log
+}  // end namespace xac
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "logger.h"
+
+namespace xac {
+
+// Compact binary log files written by FileLogAppender in BINARY mode.
+//
+// A file starts with the 8-byte magic "EZLOGBIN", a u32 version and the u64
+// time base, the program start in nanoseconds since the epoch. Then come
+// entries, each starting with a one byte tag:
+//   SITE    index, line, file name, kind, format     - once per call site
+//   LOGGER  index, name                               - once per logger name
+//   THREAD  index, thread id, fiber id, thread name   - once per thread
+//   RECORD  site, [logger, thread], time delta, payload, [fields]
+// A record's tag also holds the level and flags for the optional parts; without
+// the logger and thread they are those of the previous record, and packed
+// arguments of the same types as the site's previous record leave out their
+// count and tags. Integers are
+// LEB128 varints, strings are a varint length and the bytes. The time delta is
+// zigzag encoded against the previous record, the elapse is the time since the
+// time base. The site kind is 0
+// without a format, 1 for printf-style and 2 for `{}` formats. The payload is the
+// streamed text, or the arguments re-packed with varint integers: a count,
+// then per argument the arg_pack tag and its value. The fields are packed the
+// same way, as alternating keys and values. A file that was reopened, e.g.
+// after rotation, may hold further headers; each starts over with empty
+// dictionaries and its own time base.
+namespace binary_log {
+
+constexpr char kMagic[8] = {'E', 'Z', 'L', 'O', 'G', 'B', 'I', 'N'};
+constexpr uint32_t kVersion = 5;
+
+enum Tag : uint8_t {
+  SITE = 1,
+  LOGGER = 2,
+  THREAD = 3,
+  RECORD = 0x80,  // with the flags below, and the level in the low four bits
+};
+constexpr uint8_t kRecordArgs = 0x40;    // the payload is packed arguments, not text
+constexpr uint8_t kRecordFields = 0x20;  // fields follow the payload
+constexpr uint8_t kRecordSource = 0x10;  // the logger and thread indexes follow
+constexpr uint8_t kRecordTypes = 0x08;   // the arguments have the types of the site's previous record
+constexpr uint8_t kRecordLevel = 0x07;
+
+class Writer {
+ public:
+  // write the file header and start over with empty dictionaries
+  void Begin(std::streambuf &out, uint64_t time_base);
+  // write one record, preceded by the dictionary entries it needs the first time they show up
+  void Append(std::streambuf &out, const LogSite &site, const std::string &logger_name,
+              const std::string &thread_name, uint64_t time, uint32_t thread_id, uint32_t fiber_id,
+              LogLevel::Level level, bool has_args, std::string_view payload, std::string_view fields);
+
+ private:
+  uint64_t last_time_ = 0;
+  uint32_t last_logger_ = 0;
+  uint32_t last_thread_ = 0;
+  std::unordered_map<const LogSite *, uint32_t> sites_;
+  std::vector<std::string> site_types_;  // by site index, the argument types of its last record
+  std::string types_;
+  std::unordered_map<const std::string *, uint32_t> loggers_;  // interned names
+  std::unordered_map<std::string, uint32_t> threads_;          // by thread_key_
+  std::string thread_key_;                                     // thread id, fiber id and name
+};
+
+class Reader {
+ public:
+  explicit Reader(std::istream &in);
+  // whether the header was valid
+  bool Good() const { return good_; }
+  // the next record as an event, nullptr at the end of the file or on corrupt input
+  const LogEvent *Next();
+
+ private:
+  // read a header and start over with empty dictionaries, false if it is not valid
+  bool ReadHeader();
+  struct Thread {
+    std::string name;
+    uint32_t thread_id;
+    uint32_t fiber_id;
+  };
+  std::istream &in_;
+  bool good_ = false;
+  uint64_t time_base_ = 0;
+  uint64_t last_time_ = 0;
+  uint64_t last_logger_ = UINT64_MAX;
+  uint64_t last_thread_ = UINT64_MAX;
+  std::deque<std::string> strings_;  // owns file names and formats the sites point into
+  std::vector<std::unique_ptr<LogSite>> sites_;
+  std::vector<std::string> site_types_;  // by site index, the argument types of its last record
+  std::string field_types_;
+  std::vector<std::unique_ptr<std::string>> loggers_;
+  std::vector<std::unique_ptr<Thread>> threads_;
+  std::string payload_;
+  std::string field_str_;  // scratch for strings in the fields, payload_ may hold the message
+  LineBuffer args_;
+  LineBuffer fields_;
+  std::unique_ptr<LogEvent> event_;
+};
+
+}  // namespace binary_log
+
+}  // end namespace xac
@@ -20,6 +20,7 @@ class BlockDeque {
 
   bool full();
 
+  // wake the waiting consumers; what is queued can still be popped
   void Close();
 
   size_t size();
@@ -34,12 +35,25 @@ class BlockDeque {
 
   void push_front(const T &item);
 
+  // push_back unless the deque is full
+  bool try_push_back(const T &item);
+
   bool pop(T &item);
 
   bool pop(T &item, int timeout);
 
+  // wait for items and take all of them at once
+  bool pop_all(std::deque<T> &items);
+
+  // how often the mutex was taken by push and pop
+  size_t lock_count();
+
   void flush();
 
+  // visit the queued items unless the mutex is taken, e.g. from a signal handler
+  template <typename F>
+  bool try_for_each(F &&visit);
+
  private:
   std::deque<T> deq_;
 
@@ -49,6 +63,8 @@ class BlockDeque {
 
   bool isClose_;
 
+  size_t lockCount_ = 0;
+
   std::condition_variable condConsumer_;
 
   std::condition_variable condProducer_;
@@ -69,7 +85,6 @@ template <class T>
 void BlockDeque<T>::Close() {
   {
     std::lock_guard<std::mutex> locker(mtx_);
-    deq_.clear();
     isClose_ = true;
   }
   condProducer_.notify_all();
@@ -81,6 +96,19 @@ void BlockDeque<T>::flush() {
   condConsumer_.notify_one();
 };
 
+template <class T>
+template <typename F>
+bool BlockDeque<T>::try_for_each(F &&visit) {
+  if (!mtx_.try_lock()) {
+    return false;
+  }
+  for (const auto &item : deq_) {
+    visit(item);
+  }
+  mtx_.unlock();
+  return true;
+}
+
 template <class T>
 void BlockDeque<T>::clear() {
   std::lock_guard<std::mutex> locker(mtx_);
@@ -118,6 +146,7 @@ void BlockDeque<T>::push_back(const T &item) {
     condProducer_.wait(locker);
   }
   deq_.push_back(item);
+  ++lockCount_;
   condConsumer_.notify_one();
 }
 
@@ -128,9 +157,22 @@ void BlockDeque<T>::push_front(const T &item) {
     condProducer_.wait(locker);
   }
   deq_.push_front(item);
+  ++lockCount_;
   condConsumer_.notify_one();
 }
 
+template <class T>
+bool BlockDeque<T>::try_push_back(const T &item) {
+  std::lock_guard<std::mutex> locker(mtx_);
+  ++lockCount_;
+  if (deq_.size() >= capacity_) {
+    return false;
+  }
+  deq_.push_back(item);
+  condConsumer_.notify_one();
+  return true;
+}
+
 template <class T>
 bool BlockDeque<T>::empty() {
   std::lock_guard<std::mutex> locker(mtx_);
@@ -154,6 +196,7 @@ bool BlockDeque<T>::pop(T &item) {
   }
   item = deq_.front();
   deq_.pop_front();
+  ++lockCount_;
   condProducer_.notify_one();
   return true;
 }
@@ -171,8 +214,32 @@ bool BlockDeque<T>::pop(T &item, int timeout) {
   }
   item = deq_.front();
   deq_.pop_front();
+  ++lockCount_;
   condProducer_.notify_one();
   return true;
 }
 
+template <class T>
+bool BlockDeque<T>::pop_all(std::deque<T> &items) {
+  items.clear();
+  std::unique_lock<std::mutex> locker(mtx_);
+  while (deq_.empty()) {
+    // checked first, a Close before the wait would not wake it
+    if (isClose_) {
+      return false;
+    }
+    condConsumer_.wait(locker);
+  }
+  deq_.swap(items);
+  ++lockCount_;
+  condProducer_.notify_all();
+  return true;
+}
+
+template <class T>
+size_t BlockDeque<T>::lock_count() {
+  std::lock_guard<std::mutex> locker(mtx_);
+  return lockCount_;
+}
+
 #endif  // BLOCKQUEUE_H
\ No newline at end of file
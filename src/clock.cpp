@@ -0,0 +1,125 @@
+#include "clock.h"
+#include <chrono>
+#include <mutex>
+#include <thread>
+#if EASYLOG_HAS_TSC
+#include <cpuid.h>
+#endif
+
+namespace xac {
+
+std::atomic<Clock::Source> Clock::source_{Clock::Source::REALTIME};
+std::atomic<uint64_t> Clock::monotonic_offset_{0};
+
+auto Clock::StartNs() -> uint64_t {
+  static const uint64_t start = GetTimeNs();
+  return start;
+}
+
+namespace {
+
+// taken during static initialization, or earlier by the first event logged from another initializer
+[[maybe_unused]] const uint64_t kStartNs = Clock::StartNs();
+
+// Linear map from ticks to nanoseconds, published under a sequence lock so the
+// converting threads never wait for the one refreshing it.
+struct TscCalibration {
+  std::atomic<uint32_t> seq{0};
+  std::atomic<uint64_t> base_ticks{0};
+  std::atomic<uint64_t> base_ns{0};
+  std::atomic<double> ns_per_tick{1.0};
+  // the first sample, later rates are measured against it so they get more precise over time
+  uint64_t first_ticks = 0;
+  uint64_t first_ns = 0;
+  std::mutex refresh_mutex;
+
+  void Publish(uint64_t ticks, uint64_t ns, double rate) {
+    seq.fetch_add(1, std::memory_order_acq_rel);
+    base_ticks.store(ticks, std::memory_order_relaxed);
+    base_ns.store(ns, std::memory_order_relaxed);
+    ns_per_tick.store(rate, std::memory_order_relaxed);
+    seq.fetch_add(1, std::memory_order_release);
+  }
+};
+
+TscCalibration &GetCalibration() {
+  static TscCalibration calibration;
+  return calibration;
+}
+
+#if EASYLOG_HAS_TSC
+bool HasInvariantTsc() {
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0) {
+    return false;
+  }
+  return (edx & (1u << 8)) != 0;
+}
+#endif
+
+}  // namespace
+
+bool Clock::SetSource(Source source) {
+  if (source == Source::MONOTONIC) {
+    monotonic_offset_.store(GetTimeNs() - Read(CLOCK_MONOTONIC), std::memory_order_relaxed);
+  }
+  if (source == Source::TSC) {
+#if EASYLOG_HAS_TSC
+    if (!HasInvariantTsc()) {
+      return false;
+    }
+    auto &calibration = GetCalibration();
+    std::lock_guard guard(calibration.refresh_mutex);
+    if (calibration.first_ticks == 0) {
+      // a short first measurement, refined as the program runs
+      calibration.first_ticks = __rdtsc();
+      calibration.first_ns = GetTimeNs();
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      auto ticks = __rdtsc();
+      auto ns = GetTimeNs();
+      calibration.Publish(ticks, ns,
+                          static_cast<double>(ns - calibration.first_ns) / (ticks - calibration.first_ticks));
+    }
+#else
+    return false;
+#endif
+  }
+  source_.store(source, std::memory_order_relaxed);
+  return true;
+}
+
+auto Clock::TscToNs(uint64_t ticks) -> uint64_t {
+  auto &calibration = GetCalibration();
+  uint64_t base_ticks;
+  uint64_t base_ns;
+  double rate;
+  uint32_t seq;
+  do {
+    seq = calibration.seq.load(std::memory_order_acquire);
+    base_ticks = calibration.base_ticks.load(std::memory_order_relaxed);
+    base_ns = calibration.base_ns.load(std::memory_order_relaxed);
+    rate = calibration.ns_per_tick.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((seq & 1) != 0 || seq != calibration.seq.load(std::memory_order_relaxed));
+  auto delta = static_cast<int64_t>(ticks - base_ticks);
+#if EASYLOG_HAS_TSC
+  // refresh once the stamps are a second past the last calibration
+  if (delta * rate > 1e9 && calibration.refresh_mutex.try_lock()) {
+    auto now_ticks = __rdtsc();
+    auto now_ns = GetTimeNs();
+    if (now_ticks > calibration.first_ticks) {
+      calibration.Publish(now_ticks, now_ns,
+                          static_cast<double>(now_ns - calibration.first_ns) / (now_ticks - calibration.first_ticks));
+    }
+    calibration.refresh_mutex.unlock();
+  }
+#endif
+  return base_ns + static_cast<int64_t>(static_cast<double>(delta) * rate);
+}
+
+auto Clock::ElapseMs(uint64_t time_ns) -> uint32_t {
+  auto start = StartNs();
+  return time_ns > start ? static_cast<uint32_t>((time_ns - start) / 1000000) : 0;
+}
+
+}  // end namespace xac
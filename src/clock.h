@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include "common.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define EASYLOG_HAS_TSC 1
+#else
+#define EASYLOG_HAS_TSC 0
+#endif
+
+namespace xac {
+
+// Where LogEvent timestamps come from. `Now()` runs on the logging thread and
+// returns a stamp, `ToNs()` turns a stamp into nanoseconds since the epoch and
+// is meant to run later, e.g. on the backend thread when formatting.
+//
+// The clock_gettime sources stamp nanoseconds directly. TSC stamps are raw
+// `rdtsc` ticks tagged with the top bit, converted with a calibration against
+// CLOCK_REALTIME that is refreshed about once a second by whoever converts.
+class Clock {
+ public:
+  enum Source {
+    REALTIME = 0,         // CLOCK_REALTIME
+    REALTIME_COARSE = 1,  // CLOCK_REALTIME_COARSE, jiffy resolution but cheaper
+    MONOTONIC = 2,        // CLOCK_MONOTONIC shifted to the epoch when selected
+    TSC = 3,              // raw rdtsc, needs an invariant TSC
+  };
+
+  // switch the clock for new events, false (and no change) when `source` is not usable here
+  static bool SetSource(Source source);
+  static Source GetSource() { return source_.load(std::memory_order_relaxed); }
+
+  static uint64_t Now() {
+    switch (source_.load(std::memory_order_relaxed)) {
+      case Source::REALTIME_COARSE:
+        return Read(CLOCK_REALTIME_COARSE);
+      case Source::MONOTONIC:
+        return Read(CLOCK_MONOTONIC) + monotonic_offset_.load(std::memory_order_relaxed);
+#if EASYLOG_HAS_TSC
+      case Source::TSC:
+        return __rdtsc() | kTscBit;
+#endif
+      default:
+        return GetTimeNs();
+    }
+  }
+
+  // nanoseconds since the epoch
+  static uint64_t ToNs(uint64_t stamp) { return (stamp & kTscBit) != 0 ? TscToNs(stamp & ~kTscBit) : stamp; }
+
+  // nanoseconds since the epoch at program start
+  static uint64_t StartNs();
+  // milliseconds from program start to `time_ns`
+  static uint32_t ElapseMs(uint64_t time_ns);
+
+ private:
+  static constexpr uint64_t kTscBit = uint64_t(1) << 63;
+
+  static uint64_t Read(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+  static uint64_t TscToNs(uint64_t ticks);
+
+  static std::atomic<Source> source_;
+  static std::atomic<uint64_t> monotonic_offset_;
+};
+
+}  // end namespace xac
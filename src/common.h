@@ -1,16 +1,28 @@
 #pragma once
+#include <cstdint>
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <ctime>
 #include <unistd.h>
 
 namespace xac {
 
-static std::string GetThreadName() { return ""; }
+inline const std::string &GetThreadName() {
+  thread_local std::string thread_name;
+  return thread_name;
+}
 
-static int GetThreadId() { return gettid(); }
+inline int GetThreadId() { return gettid(); }
 
-static int GetFiberId() { return 1; }
+// wall clock time in nanoseconds since the epoch
+inline uint64_t GetTimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+inline int GetFiberId() { return 1; }
 
 template <typename T> class Singleton {
 public:
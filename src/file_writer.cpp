@@ -0,0 +1,125 @@
+#include "file_writer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace xac {
+
+FileWriter::FileWriter(size_t capacity) : buf_(capacity > 0 ? capacity : 1) {
+  setp(buf_.data(), buf_.data() + buf_.size());
+}
+
+FileWriter::~FileWriter() { Close(); }
+
+auto FileWriter::Open(const std::string &path, bool truncate) -> bool {
+  Close();
+  fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+  return fd_ >= 0;
+}
+
+void FileWriter::Close() {
+  if (fd_ < 0) {
+    return;
+  }
+  Flush();
+  close(fd_);
+  fd_ = -1;
+}
+
+auto FileWriter::Flush() -> bool {
+  auto len = Buffered();
+  setp(buf_.data(), buf_.data() + buf_.size());
+  return len == 0 || WriteAll(buf_.data(), len);
+}
+
+auto FileWriter::WriteV(struct iovec *iov, size_t count) -> bool {
+  for (size_t i = 0; i < count; i++) {
+    written_ += iov[i].iov_len;
+  }
+  if (!Flush() || fd_ < 0) {
+    return false;
+  }
+  while (count > 0) {
+    auto n = writev(fd_, iov, static_cast<int>(std::min<size_t>(count, IOV_MAX)));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    // skip what was written, the last piece may be partial
+    auto written = static_cast<size_t>(n);
+    while (count > 0 && written >= iov->iov_len) {
+      written -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+      iov->iov_len -= written;
+    }
+  }
+  return true;
+}
+
+auto FileWriter::Sync() -> bool { return Flush() && fd_ >= 0 && fdatasync(fd_) == 0; }
+
+void FileWriter::SetCapacity(size_t capacity) {
+  Flush();
+  buf_.resize(capacity > 0 ? capacity : 1);
+  setp(buf_.data(), buf_.data() + buf_.size());
+}
+
+auto FileWriter::WriteAll(const char *data, size_t len) -> bool {
+  written_ += len;
+  if (fd_ < 0) {
+    return false;
+  }
+  while (len > 0) {
+    auto n = write(fd_, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+auto FileWriter::overflow(int_type ch) -> int_type {
+  if (!Flush()) {
+    return traits_type::eof();
+  }
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+auto FileWriter::xsputn(const char *data, std::streamsize len) -> std::streamsize {
+  auto size = static_cast<size_t>(len);
+  if (size <= static_cast<size_t>(epptr() - pptr())) {
+    memcpy(pptr(), data, size);
+    pbump(static_cast<int>(size));
+    return len;
+  }
+  // does not fit, send what is buffered and then either buffer the rest or write it straight through
+  if (!Flush()) {
+    return 0;
+  }
+  if (size < buf_.size()) {
+    memcpy(pptr(), data, size);
+    pbump(static_cast<int>(size));
+    return len;
+  }
+  return WriteAll(data, size) ? len : 0;
+}
+
+}  // end namespace xac
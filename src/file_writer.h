@@ -0,0 +1,48 @@
+#pragma once
+
+#include <sys/uio.h>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace xac {
+
+// An append-only file behind a user-space buffer. Bytes only reach the kernel
+// with one write(2) per `Flush`, when the buffer is full, or for writes too
+// large to buffer. Not thread safe.
+class FileWriter : public std::streambuf {
+ public:
+  explicit FileWriter(size_t capacity = kDefaultCapacity);
+  FileWriter(const FileWriter &) = delete;
+  ~FileWriter() override;
+  // flush and close the current file, then open `path` for appending
+  bool Open(const std::string &path, bool truncate = false);
+  void Close();
+  bool IsOpen() const { return fd_ >= 0; }
+  // write out the buffered bytes
+  bool Flush();
+  // flush, then write the `count` pieces of `iov` with writev(2), IOV_MAX at a time; `iov` is modified
+  bool WriteV(struct iovec *iov, size_t count);
+  // flush and fsync
+  bool Sync();
+  // flush and resize the buffer
+  void SetCapacity(size_t capacity);
+  size_t Buffered() const { return pptr() - pbase(); }
+  // bytes appended since construction, buffered or written
+  uint64_t Appended() const { return written_ + Buffered(); }
+
+  static constexpr size_t kDefaultCapacity = 64 * 1024;
+
+ protected:
+  int_type overflow(int_type ch) override;
+  std::streamsize xsputn(const char *data, std::streamsize len) override;
+  int sync() override { return Flush() ? 0 : -1; }
+
+ private:
+  bool WriteAll(const char *data, size_t len);
+  int fd_ = -1;
+  std::vector<char> buf_;
+  uint64_t written_ = 0;  // handed to the kernel, or lost to a failed write
+};
+
+}  // end namespace xac
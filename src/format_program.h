@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace xac {
+
+// A Formatter pattern compiled into a flat list of instructions. The parser is
+// constexpr so the same code compiles runtime patterns and patterns known at
+// compile time (see StaticFormatter).
+namespace format_program {
+
+enum Op : uint8_t {
+  LITERAL,      // arg is the text
+  CONTENT,      // %m
+  LEVEL,        // %p
+  ELAPSE,       // %r
+  LOGGER_NAME,  // %c
+  THREAD_ID,    // %t
+  NEW_LINE,     // %n
+  TIME,         // %d{strftime format, plus %L %f %N for ms us ns}
+  FILE_NAME,    // %f
+  LINE,         // %l
+  TAB,          // %T
+  FIBER_ID,     // %F
+  THREAD_NAME,  // %N
+  JSON,         // %j{time format}, the whole event as one JSON object
+  FIELDS,       // %K, the key-value fields as ` key=value`
+  ERROR,        // unknown item, arg is its name
+};
+
+struct Instruction {
+  Op op;
+  std::string_view arg;  // points into the pattern
+};
+
+constexpr bool IsAlpha(char ch) { return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z'); }
+
+constexpr Op ToOp(std::string_view item) {
+  if (item.size() != 1) {
+    return Op::ERROR;
+  }
+  switch (item[0]) {
+    case 'm':
+      return Op::CONTENT;
+    case 'p':
+      return Op::LEVEL;
+    case 'r':
+      return Op::ELAPSE;
+    case 'c':
+      return Op::LOGGER_NAME;
+    case 't':
+      return Op::THREAD_ID;
+    case 'n':
+      return Op::NEW_LINE;
+    case 'd':
+      return Op::TIME;
+    case 'f':
+      return Op::FILE_NAME;
+    case 'l':
+      return Op::LINE;
+    case 'T':
+      return Op::TAB;
+    case 'F':
+      return Op::FIBER_ID;
+    case 'N':
+      return Op::THREAD_NAME;
+    case 'j':
+      return Op::JSON;
+    case 'K':
+      return Op::FIELDS;
+    default:
+      return Op::ERROR;
+  }
+}
+
+// Call `emit(Instruction)` for every piece of `pattern`: literal text, `%%`
+// for a percent sign, `%x` items and `%x{fmt}` items with a parameter.
+template <typename Emit>
+constexpr void Parse(std::string_view pattern, Emit &&emit) {
+  size_t literal = 0;
+  size_t i = 0;
+  while (i < pattern.size()) {
+    if (pattern[i] != '%') {
+      ++i;
+      continue;
+    }
+    if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+      // keep the first % as text, skip the second
+      emit(Instruction{Op::LITERAL, pattern.substr(literal, i + 1 - literal)});
+      i += 2;
+      literal = i;
+      continue;
+    }
+    if (i > literal) {
+      emit(Instruction{Op::LITERAL, pattern.substr(literal, i - literal)});
+    }
+    size_t end = i + 1;
+    while (end < pattern.size() && IsAlpha(pattern[end])) {
+      ++end;
+    }
+    auto item = pattern.substr(i + 1, end - i - 1);
+    std::string_view param;
+    if (end < pattern.size() && pattern[end] == '{') {
+      auto close = pattern.find('}', end + 1);
+      if (close == std::string_view::npos) {
+        close = pattern.size();
+      }
+      param = pattern.substr(end + 1, close - end - 1);
+      end = close < pattern.size() ? close + 1 : close;
+    }
+    auto op = ToOp(item);
+    emit(Instruction{op, op == Op::ERROR ? item : param});
+    i = end;
+    literal = end;
+  }
+  if (pattern.size() > literal) {
+    emit(Instruction{Op::LITERAL, pattern.substr(literal)});
+  }
+}
+
+constexpr size_t Count(std::string_view pattern) {
+  size_t count = 0;
+  Parse(pattern, [&count](const Instruction &) { ++count; });
+  return count;
+}
+
+template <size_t N>
+struct Program {
+  Instruction code[N > 0 ? N : 1];
+};
+
+template <size_t N>
+constexpr Program<N> Compile(std::string_view pattern) {
+  Program<N> program{};
+  size_t n = 0;
+  Parse(pattern, [&](const Instruction &ins) { program.code[n++] = ins; });
+  return program;
+}
+
+}  // namespace format_program
+
+}  // end namespace xac
@@ -0,0 +1,89 @@
+#include "json.h"
+#include <charconv>
+#include <cmath>
+
+namespace xac {
+namespace json {
+
+void PutString(std::streambuf &out, std::string_view str) {
+  out.sputc('"');
+  const char *p = str.data();
+  const char *end = p + str.size();
+  while (p < end) {
+    // copy the run that needs no escaping in one piece
+    const char *run = p;
+    while (p < end && static_cast<unsigned char>(*p) >= 0x20 && *p != '"' && *p != '\\') {
+      ++p;
+    }
+    out.sputn(run, p - run);
+    if (p == end) {
+      break;
+    }
+    char escaped[6] = {'\\', *p, 0, 0, 0, 0};
+    size_t len = 2;
+    switch (*p) {
+      case '\n':
+        escaped[1] = 'n';
+        break;
+      case '\r':
+        escaped[1] = 'r';
+        break;
+      case '\t':
+        escaped[1] = 't';
+        break;
+      case '\b':
+        escaped[1] = 'b';
+        break;
+      case '\f':
+        escaped[1] = 'f';
+        break;
+      case '"':
+      case '\\':
+        break;
+      default: {
+        static constexpr char kHex[] = "0123456789abcdef";
+        auto ch = static_cast<unsigned char>(*p);
+        escaped[1] = 'u';
+        escaped[2] = '0';
+        escaped[3] = '0';
+        escaped[4] = kHex[ch >> 4];
+        escaped[5] = kHex[ch & 0xf];
+        len = 6;
+      }
+    }
+    out.sputn(escaped, static_cast<std::streamsize>(len));
+    ++p;
+  }
+  out.sputc('"');
+}
+
+void PutValue(std::streambuf &out, const arg_pack::Arg &arg) {
+  switch (arg.type) {
+    case arg_pack::ArgType::STRING:
+      PutString(out, std::string_view(arg.str, arg.len));
+      return;
+    case arg_pack::ArgType::CHAR: {
+      char ch = static_cast<char>(arg.u);
+      PutString(out, std::string_view(&ch, 1));
+      return;
+    }
+    case arg_pack::ArgType::POINTER:
+      out.sputc('"');
+      arg_pack::PrintValue(out, arg);
+      out.sputc('"');
+      return;
+    case arg_pack::ArgType::DOUBLE:
+      if (!std::isfinite(arg.d)) {
+        out.sputn("null", 4);
+        return;
+      }
+      arg_pack::PrintValue(out, arg);
+      return;
+    default:
+      // INT, UINT and BOOL print as JSON already
+      arg_pack::PrintValue(out, arg);
+  }
+}
+
+}  // namespace json
+}  // end namespace xac
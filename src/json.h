@@ -0,0 +1,19 @@
+#pragma once
+
+#include <streambuf>
+#include <string_view>
+#include "arg_pack.h"
+
+namespace xac {
+
+// JSON output for the %j format item, written straight into the output buffer.
+namespace json {
+
+// `str` as a quoted JSON string; bytes above 0x7f pass through, so UTF-8 stays UTF-8
+void PutString(std::streambuf &out, std::string_view str);
+// an arg_pack argument as a JSON value; non-finite doubles become null
+void PutValue(std::streambuf &out, const arg_pack::Arg &arg);
+
+}  // namespace json
+
+}  // end namespace xac
@@ -0,0 +1,51 @@
+#include "log_stream.h"
+#include <algorithm>
+
+namespace xac {
+
+void LogStream::Clear() {
+  if (heap_ != nullptr) {
+    setp(heap_.get(), heap_.get() + heap_size_);
+  } else {
+    setp(inline_, inline_ + kInlineSize);
+  }
+  if (os_) {
+    // undo whatever manipulators the previous statement left behind
+    os_->clear();
+    os_->flags(std::ios_base::skipws | std::ios_base::dec);
+    os_->precision(6);
+    os_->width(0);
+    os_->fill(' ');
+  }
+  plain_ = true;
+  fields_.text.clear();
+}
+
+void LogStream::Grow(size_t n) {
+  auto used = static_cast<size_t>(pptr() - pbase());
+  auto size = std::max(static_cast<size_t>(epptr() - pbase()) * 2, used + n);
+  auto heap = std::make_unique<char[]>(size);
+  memcpy(heap.get(), pbase(), used);
+  heap_ = std::move(heap);
+  heap_size_ = size;
+  setp(heap_.get(), heap_.get() + heap_size_);
+  pbump(static_cast<int>(used));
+}
+
+auto LogStream::overflow(int_type ch) -> int_type {
+  Grow(1);
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+auto LogStream::xsputn(const char *data, std::streamsize len) -> std::streamsize {
+  auto size = static_cast<size_t>(len);
+  memcpy(Reserve(size), data, size);
+  pbump(static_cast<int>(size));
+  return len;
+}
+
+}  // end namespace xac
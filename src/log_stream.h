@@ -0,0 +1,119 @@
+#pragma once
+
+#include <charconv>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "arg_pack.h"
+
+namespace xac {
+
+// The `<<` target of the streaming macros. Text goes into a buffer inside the
+// object and only moves to the heap when it outgrows it. Numbers are printed
+// with std::to_chars the way a default std::ostream prints them; manipulators
+// and types that only have an ostream operator<< go through a std::ostream that
+// is built on first use, and numbers follow it while its formatting is changed.
+// Key-value fields attached with `kv` are kept apart from the text, encoded
+// by arg_pack as a key string followed by the typed value.
+class LogStream : public std::streambuf {
+ public:
+  static constexpr size_t kInlineSize = 256;
+
+  LogStream() { setp(inline_, inline_ + kInlineSize); }
+  LogStream(const LogStream &) = delete;
+  std::string_view View() const { return {pbase(), static_cast<size_t>(pptr() - pbase())}; }
+  // drop the content and any formatting state, keep the storage
+  void Clear();
+  LogStream &write(const char *data, std::streamsize len) {
+    sputn(data, len);
+    return *this;
+  }
+  // attach a typed field, e.g. `LINFO("svc").kv("user", id) << "done"`
+  template <typename T>
+  LogStream &kv(std::string_view key, const T &value) {
+    arg_pack::Encode(fields_, key);
+    arg_pack::Encode(fields_, value);
+    return *this;
+  }
+  // the fields as key, value pairs of arg_pack arguments
+  std::string_view Fields() const { return fields_.text; }
+  // take fields that were captured elsewhere
+  void SetFields(std::string_view packed) { fields_.text.assign(packed); }
+
+  LogStream &operator<<(std::string_view str) { return write(str.data(), static_cast<std::streamsize>(str.size())); }
+  LogStream &operator<<(const std::string &str) { return *this << std::string_view(str); }
+  LogStream &operator<<(const char *str) { return str != nullptr ? *this << std::string_view(str) : *this; }
+  LogStream &operator<<(char *str) { return *this << static_cast<const char *>(str); }
+  LogStream &operator<<(char ch) {
+    if (plain_) {
+      sputc(ch);
+      return *this;
+    }
+    return Fallback(ch);
+  }
+  LogStream &operator<<(signed char ch) { return *this << static_cast<char>(ch); }
+  LogStream &operator<<(unsigned char ch) { return *this << static_cast<char>(ch); }
+  LogStream &operator<<(bool value) { return plain_ ? *this << (value ? '1' : '0') : Fallback(value); }
+  template <typename T, std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
+  LogStream &operator<<(T value) {
+    if (!plain_) {
+      return Fallback(value);
+    }
+    auto *first = Reserve(kMaxNumberSize);
+    std::to_chars_result result;
+    if constexpr (std::is_floating_point_v<T>) {
+      // the default ostream precision, like %g
+      result = std::to_chars(first, first + kMaxNumberSize, value, std::chars_format::general, 6);
+    } else {
+      result = std::to_chars(first, first + kMaxNumberSize, value);
+    }
+    pbump(static_cast<int>(result.ptr - first));
+    return *this;
+  }
+  LogStream &operator<<(std::ostream &(*manipulator)(std::ostream &)) { return Fallback(manipulator); }
+  LogStream &operator<<(std::ios_base &(*manipulator)(std::ios_base &)) { return Fallback(manipulator); }
+  // pointers, enums, <iomanip> manipulators and user types
+  template <typename T, std::enable_if_t<!std::is_arithmetic_v<T>, int> = 0>
+  LogStream &operator<<(const T &value) {
+    return Fallback(value);
+  }
+
+ protected:
+  int_type overflow(int_type ch) override;
+  std::streamsize xsputn(const char *data, std::streamsize len) override;
+
+ private:
+  static constexpr size_t kMaxNumberSize = 64;
+  // room for at least `n` more bytes at the write position
+  char *Reserve(size_t n) {
+    if (static_cast<size_t>(epptr() - pptr()) < n) {
+      Grow(n);
+    }
+    return pptr();
+  }
+  // move the content to a heap buffer with room for `n` more bytes
+  void Grow(size_t n);
+  template <typename T>
+  LogStream &Fallback(const T &value) {
+    if (!os_) {
+      os_.emplace(this);
+    }
+    *os_ << value;
+    plain_ = os_->flags() == (std::ios_base::skipws | std::ios_base::dec) && os_->precision() == 6 &&
+             os_->width() == 0;
+    return *this;
+  }
+  char inline_[kInlineSize];
+  std::unique_ptr<char[]> heap_;  // kept across Clear once the content outgrew inline_
+  size_t heap_size_ = 0;
+  std::optional<std::ostream> os_;
+  bool plain_ = true;  // the formatting is the default, numbers can skip os_
+  arg_pack::StringSink fields_;
+};
+
+}  // end namespace xac
@@ -1,5 +1,12 @@
 #include "logger.h"
+#include <fnmatch.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
 #include <iostream>
+#include <set>
+#include "binary_log.h"
+#include "json.h"
 
 namespace xac {
 auto LogLevel::ToLevel(const std::string &level_str) -> LogLevel::Level {
@@ -12,33 +19,193 @@ auto LogLevel::ToLevel(const std::string &level_str) -> LogLevel::Level {
   XX(WARN)
   XX(ERROR)
   XX(FATAL)
+  XX(OFF)
 #undef XX
   return LogLevel::Level::UNKNOWN;
 }
 
-constexpr auto LogLevel::ToString(LogLevel::Level level) -> const char * {
-  switch (level) {
-#define XX(L)              \
-  case LogLevel::Level::L: \
-    return #L;
-    XX(DEBUG)
-    XX(INFO)
-    XX(WARN)
-    XX(ERROR)
-    XX(FATAL)
-#undef XX
-    default:
-      return "UNKNOWN";
+// Names handed out here are never freed, so events and queued records can keep a pointer
+static auto InternName(const std::string &name) -> const std::string & {
+  static std::mutex mutex;
+  static std::set<std::string> names;
+  std::lock_guard guard(mutex);
+  return *names.insert(name).first;
+}
+
+namespace {
+
+struct SiteRegistry {
+  std::mutex mutex;
+  std::vector<LogSite *> sites;
+  std::vector<std::pair<std::string, LogSite::State>> rules;  // SetState calls, applied in order
+};
+
+SiteRegistry &GetSiteRegistry() {
+  static auto *registry = new SiteRegistry();  // statements may still run during static destruction
+  return *registry;
+}
+
+// `pattern` is a glob on the file name or its base name, optionally followed by ":line"
+bool SiteMatches(const LogSite &site, const std::string &pattern) {
+  std::string glob = pattern;
+  auto colon = pattern.rfind(':');
+  if (colon != std::string::npos && colon + 1 < pattern.size() &&
+      pattern.find_first_not_of("0123456789", colon + 1) == std::string::npos) {
+    if (std::stoul(pattern.substr(colon + 1)) != site.line) {
+      return false;
+    }
+    glob = pattern.substr(0, colon);
+  }
+  const char *base_name = strrchr(site.file_name, '/');
+  return fnmatch(glob.c_str(), site.file_name, 0) == 0 ||
+         (base_name != nullptr && fnmatch(glob.c_str(), base_name + 1, 0) == 0);
+}
+
+}  // namespace
+
+auto LogSite::Register() -> State {
+  auto &registry = GetSiteRegistry();
+  std::lock_guard guard(registry.mutex);
+  auto current = state.load(std::memory_order_relaxed);
+  if (current != UNREGISTERED) {
+    return current;
+  }
+  current = DEFAULT;
+  for (const auto &[pattern, rule_state] : registry.rules) {
+    if (SiteMatches(*this, pattern)) {
+      current = rule_state;
+    }
   }
+  registry.sites.push_back(this);
+  state.store(current, std::memory_order_relaxed);
+  return current;
+}
+
+auto LogSite::List() -> std::vector<const LogSite *> {
+  auto &registry = GetSiteRegistry();
+  std::lock_guard guard(registry.mutex);
+  return {registry.sites.begin(), registry.sites.end()};
 }
 
-Logger::Logger(const std::string &name) : name_(name) {}
+auto LogSite::SetState(const std::string &pattern, State state) -> size_t {
+  auto &registry = GetSiteRegistry();
+  std::lock_guard guard(registry.mutex);
+  // a later rule for the same pattern replaces the earlier one
+  registry.rules.erase(std::remove_if(registry.rules.begin(), registry.rules.end(),
+                                      [&](const auto &rule) { return rule.first == pattern; }),
+                       registry.rules.end());
+  registry.rules.emplace_back(pattern, state);
+  size_t matched = 0;
+  for (auto *site : registry.sites) {
+    if (SiteMatches(*site, pattern)) {
+      site->state.store(state, std::memory_order_relaxed);
+      ++matched;
+    }
+  }
+  return matched;
+}
+
+Logger::Logger(const std::string &name, bool additive)
+    : name_(&InternName(name)), additive_(additive), log_appenders_(new AppenderList()) {}
+
+Logger::~Logger() {
+  ClearAppenders();
+  delete log_appenders_.load(std::memory_order_relaxed);
+}
 
-Logger::~Logger() { log_appenders_.clear(); }
+void Logger::Publish(std::unique_ptr<AppenderList> appenders) {
+  std::unique_ptr<const AppenderList> old(log_appenders_.exchange(appenders.release(), std::memory_order_acq_rel));
+  rcu::Synchronize();
+}
 
 void Logger::AddAppender(const LogAppenderBase::SharedPtr &appender) {
-  std::unique_lock guard(shared_mutex_);
-  log_appenders_.push_back(appender);
+  {
+    std::lock_guard guard(mutex_);
+    auto appenders = std::make_unique<AppenderList>(*log_appenders_.load(std::memory_order_relaxed));
+    appenders->push_back(appender);
+    Publish(std::move(appenders));
+  }
+  {
+    std::unique_lock guard(appender->shared_mutex_);
+    appender->owners_.push_back(this);
+  }
+  UpdateLevel();
+}
+
+void Logger::DeleteAppender(const LogAppenderBase::SharedPtr &appender) {
+  {
+    std::lock_guard guard(mutex_);
+    auto appenders = std::make_unique<AppenderList>(*log_appenders_.load(std::memory_order_relaxed));
+    auto it = std::find(appenders->begin(), appenders->end(), appender);
+    if (it == appenders->end()) {
+      return;
+    }
+    appenders->erase(it);
+    Publish(std::move(appenders));
+  }
+  {
+    std::unique_lock guard(appender->shared_mutex_);
+    appender->owners_.erase(std::remove(appender->owners_.begin(), appender->owners_.end(), this),
+                            appender->owners_.end());
+  }
+  UpdateLevel();
+}
+
+void Logger::ClearAppenders() {
+  AppenderList appenders;
+  {
+    std::lock_guard guard(mutex_);
+    appenders = *log_appenders_.load(std::memory_order_relaxed);
+    Publish(std::make_unique<AppenderList>());
+  }
+  for (const auto &it : appenders) {
+    std::unique_lock guard(it->shared_mutex_);
+    it->owners_.erase(std::remove(it->owners_.begin(), it->owners_.end(), this), it->owners_.end());
+  }
+  UpdateLevel();
+}
+
+void Logger::SetLevel(LogLevel::Level level) {
+  own_level_.store(level, std::memory_order_relaxed);
+  UpdateLevel();
+}
+
+void Logger::SetAdditivity(bool additive) {
+  additive_.store(additive, std::memory_order_relaxed);
+  UpdateLevel();
+}
+
+void Logger::UpdateLevel() {
+  if (registered_.load(std::memory_order_acquire)) {
+    // descendants may inherit from this logger, recompute the whole tree
+    auto *manager = LoggerManager::GetInstance();
+    std::lock_guard guard(manager->mutex_);
+    manager->UpdateLevels();
+    return;
+  }
+  std::lock_guard guard(mutex_);
+  ComputeLevel();
+}
+
+void Logger::ComputeLevel() {
+  auto *parent = GetParent();
+  auto threshold = own_level_.load(std::memory_order_relaxed);
+  if (threshold == LogLevel::Level::UNKNOWN && parent != nullptr) {
+    threshold = parent->threshold_.load(std::memory_order_relaxed);
+  }
+  auto reach = LogLevel::Level::OFF;
+  if (parent != nullptr && additive_.load(std::memory_order_relaxed)) {
+    reach = parent->reach_.load(std::memory_order_relaxed);
+  }
+  {
+    rcu::ReadGuard guard;
+    for (const auto &it : *log_appenders_.load(std::memory_order_acquire)) {
+      reach = std::min(reach, it->level_.load());
+    }
+  }
+  threshold_.store(threshold, std::memory_order_relaxed);
+  reach_.store(reach, std::memory_order_relaxed);
+  level_.store(std::max(threshold, reach), std::memory_order_relaxed);
 }
 
 // //TODO:thread safe get appender
@@ -58,59 +225,306 @@ void Logger::AddAppender(const LogAppenderBase::SharedPtr &appender) {
 //     log_appenders_.erase(appender_name);
 // }
 
-void Logger::Log(const LogEvent::SharedPtr &event) {
-  auto event_level = event->GetLevel();
-  auto guard = std::unique_lock(shared_mutex_);
-  for (const auto &it : log_appenders_) {
-    it->Log(event_level, event);
+void Logger::Log(const LogEvent &event) {
+  auto event_level = event.GetLevel();
+  if (event_level < threshold_.load(std::memory_order_relaxed) &&
+      event.GetSite().state.load(std::memory_order_relaxed) != LogSite::ON) {
+    return;
+  }
+  events_.Add(1);
+  rcu::ReadGuard guard;
+  // up the tree while the loggers are additive, parents stay alive for the read section
+  for (const Logger *logger = this; logger != nullptr;
+       logger = logger->additive_.load(std::memory_order_relaxed) ? logger->GetParent() : nullptr) {
+    for (const auto &it : *logger->log_appenders_.load(std::memory_order_acquire)) {
+      it->Log(event_level, event);
+    }
+  }
+}
+
+auto Logger::GetStats() const -> LoggerStats {
+  LoggerStats stats;
+  stats.name = *name_;
+  stats.events = events_.Load();
+  rcu::ReadGuard guard;
+  for (const auto &appender : *log_appenders_.load(std::memory_order_acquire)) {
+    stats.appenders.push_back(appender->GetStats());
+    stats.bytes += stats.appenders.back().bytes;
+    stats.drops += stats.appenders.back().drops;
+  }
+  return stats;
+}
+
+auto LineBuffer::overflow(int_type ch) -> int_type {
+  auto used = pptr() - pbase();
+  buf_.resize(std::max<size_t>(128, buf_.size() * 2));
+  setp(buf_.data(), buf_.data() + buf_.size());
+  pbump(static_cast<int>(used));
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+auto LineBuffer::Reserve(size_t n) -> char * {
+  while (Available() < n) {
+    overflow(traits_type::eof());
+  }
+  return pptr();
+}
+
+LogEvent::LogEvent(const LogSite &site, const uint64_t &time, const uint32_t &elapse, const uint32_t &thread_id,
+                   const std::string &thread_name, const uint32_t &fiber_id, const std::string &logger_name,
+                   LogLevel::Level level) {
+  Reset(site, time, elapse, thread_id, thread_name, fiber_id, logger_name, level);
+}
+
+void LogEvent::Reset(const LogSite &site, const uint64_t &time, const uint32_t &elapse, const uint32_t &thread_id,
+                     const std::string &thread_name, const uint32_t &fiber_id, const std::string &logger_name,
+                     LogLevel::Level level) {
+  site_ = &site;
+  time_ = time;
+  elapse_ = elapse;
+  thread_id_ = thread_id;
+  thread_name_ = &thread_name;
+  fiber_id_ = fiber_id;
+  logger_name_ = &logger_name;
+  level_ = level;
+  format_ = nullptr;
+  content_.Clear();
+}
+
+auto LogEvent::GetContent() const -> std::string_view {
+  if (format_ != nullptr && !formatted_) {
+    if (braces_) {
+      arg_pack::FormatBraces(content_, format_, args_buf_.View());
+    } else {
+      arg_pack::FormatArgs(content_, format_, args_buf_.View());
+    }
+    formatted_ = true;
   }
+  return content_.View();
+}
+
+void LogEvent::SetArgs(const char *format, std::string_view packed, bool braces) {
+  format_ = format;
+  braces_ = braces;
+  formatted_ = false;
+  args_buf_.Clear();
+  args_buf_.sputn(packed.data(), static_cast<std::streamsize>(packed.size()));
 }
 
-void LogEvent::Format(const char *format, ...) {
-  va_list valist;
-  va_start(valist, format);
-  char *buf = nullptr;
-  int len = vasprintf(&buf, format, valist);
-  if (len != -1) {
-    content_ss_ << std::string(buf, len);
-    free(buf);
+// Per-thread free list of events, events are only ever used by the thread that acquired them
+struct LogEventPool {
+  LogEvent *head = nullptr;
+  ~LogEventPool() {
+    while (head != nullptr) {
+      auto *next = head->next_free_;
+      delete head;
+      head = next;
+    }
   }
-  va_end(valist);
+};
+static thread_local LogEventPool log_event_pool;
+
+auto LogEvent::Acquire(const LogSite &site, const uint64_t &time, const uint32_t &elapse, const uint32_t &thread_id,
+                       const std::string &thread_name, const uint32_t &fiber_id, const std::string &logger_name,
+                       LogLevel::Level level) -> LogEvent * {
+  auto *event = log_event_pool.head;
+  if (event == nullptr) {
+    return new LogEvent(site, time, elapse, thread_id, thread_name, fiber_id, logger_name, level);
+  }
+  log_event_pool.head = event->next_free_;
+  event->Reset(site, time, elapse, thread_id, thread_name, fiber_id, logger_name, level);
+  return event;
 }
 
-LogEvent::LogEvent(const char *file_name, const uint64_t &time, const uint32_t &elapse, const uint32_t &line,
-                   const uint32_t &thread_id, std::string thread_name, const uint32_t &fiber_id,
-                   std::string logger_name, LogLevel::Level level)
-    : file_name_(file_name),
-      time_(time),
-      elapse_(elapse),
-      line_(line),
-      thread_id_(thread_id),
-      thread_name_(std::move(thread_name)),
-      fiber_id_(fiber_id),
-      logger_name_(std::move(logger_name)),
-      level_(level) {}
+void LogEvent::Release(LogEvent *event) {
+  event->next_free_ = log_event_pool.head;
+  log_event_pool.head = event;
+}
 
-LogEventWrap::~LogEventWrap() { LoggerManager::GetInstance()->GetLogger(event_->logger_name_)->Log(event_); }
+LogEventWrap::~LogEventWrap() {
+  logger_->Log(*event_);
+  LogEvent::Release(event_);
+}
 
-const std::string Formatter::COMPLEXPATTERN = "[%p]%d{%Y-%m-%d %H:%M:%S}%T(tid)%t%T[%c]%T%f:%l%T%m%n";
+const std::string Formatter::COMPLEXPATTERN = kComplexPattern;
 // const std::string Formatter::COMPLEXPATTERN = "[%p]%d{%Y-%m-%d
 // %H:%M:%S}%T(tid)%t%T(tname)%N%T(fid)%F%T[%c]%T%f:%l%T%m%n";
-const std::string Formatter::SIMPLEPATTERN = "[%p]%T[%c]%T%f:%l%T%m%n";
+const std::string Formatter::SIMPLEPATTERN = kSimplePattern;
+const std::string Formatter::JSONPATTERN = kJsonPattern;
+
+void Formatter::FormatJson(std::string_view time_format, LineBuffer &out, LogLevel::Level level,
+                           const LogEvent &event) {
+  auto key = [&out](std::string_view name) {
+    out.sputn(name.data(), static_cast<std::streamsize>(name.size()));
+  };
+  auto number = [&out](uint64_t value) {
+    auto *dst = out.Reserve(20);
+    out.Commit(std::to_chars(dst, dst + 20, value).ptr - dst);
+  };
+  char time[128];
+  auto time_len = FormatTime(time_format.empty() ? kJsonTimeFormat : time_format, event.GetTime(), time, sizeof(time));
+  key("{\"time\":");
+  json::PutString(out, std::string_view(time, time_len));
+  key(",\"level\":\"");
+  key(LogLevel::ToString(level));
+  key("\",\"logger\":");
+  json::PutString(out, event.GetLoggerName());
+  key(",\"thread_id\":");
+  number(event.GetThreadId());
+  key(",\"thread_name\":");
+  json::PutString(out, event.GetThreadName());
+  key(",\"fiber_id\":");
+  number(event.GetFiberId());
+  key(",\"file\":");
+  json::PutString(out, event.GetFileName());
+  key(",\"line\":");
+  number(event.GetLine());
+  key(",\"message\":");
+  json::PutString(out, event.GetContent());
+  arg_pack::Arg name;
+  arg_pack::Arg value;
+  for (auto fields = event.GetFields(); arg_pack::Next(fields, name) && arg_pack::Next(fields, value);) {
+    out.sputc(',');
+    json::PutString(out, std::string_view(name.str, name.len));
+    out.sputc(':');
+    json::PutValue(out, value);
+  }
+  out.sputc('}');
+}
+
+void Formatter::FormatFields(LineBuffer &out, const LogEvent &event) {
+  arg_pack::Arg name;
+  arg_pack::Arg value;
+  for (auto fields = event.GetFields(); arg_pack::Next(fields, name) && arg_pack::Next(fields, value);) {
+    out.sputc(' ');
+    out.sputn(name.str, name.len);
+    out.sputc('=');
+    arg_pack::PrintValue(out, value);
+  }
+}
 
 Formatter::Formatter(std::string pattern) : pattern_(std::move(pattern)) { PatternParse(); }
 
-void Formatter::Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) {
+void Formatter::Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) {
   for (const auto &it : format_items_) {
     it->Format(os, level, event);
   }
 }
 
+void Formatter::Format(LineBuffer &out, LogLevel::Level level, const LogEvent &event) {
+  for (const auto &ins : program_) {
+    Execute(ins, out, level, event);
+  }
+}
+
 LogAppenderBase::LogAppenderBase() { formatter_ = std::make_shared<Formatter>(); }
 
+// What a DEFERRED appender queues per event, followed by the thread name and the
+// packed arguments (or the streamed text). Pointers are to static sites and interned names.
+struct DeferredRecord {
+  const LogSite *site;
+  const std::string *logger_name;
+  uint64_t time;    // Clock stamp
+  uint32_t elapse;  // may be LogEvent::kElapseFromTime
+  uint32_t thread_id;
+  uint32_t fiber_id;
+  LogLevel::Level level;
+  uint32_t thread_name_len;
+  uint32_t payload_len;
+  bool has_args;
+  uint32_t fields_len;  // followed by the thread name, the payload and the fields
+};
+
+// Calls FileLogAppender::OnTimer at the deadlines the appenders ask for, so
+// buffered lines get written when their logger goes quiet.
+class AppenderTimer {
+ public:
+  // never destroyed, appenders may cancel from static destructors at exit
+  static AppenderTimer &Get() {
+    static auto *timer = new AppenderTimer();
+    return *timer;
+  }
+  void Schedule(FileLogAppender *appender, std::chrono::steady_clock::time_point deadline) {
+    std::lock_guard guard(mutex_);
+    bool earliest = deadlines_.empty() || deadline < deadlines_.begin()->first;
+    deadlines_.emplace(deadline, appender);
+    if (earliest) {
+      cond_.notify_one();
+    }
+  }
+  // drop the deadlines of `appender`, waits while its OnTimer runs
+  void Cancel(FileLogAppender *appender) {
+    std::unique_lock lock(mutex_);
+    for (auto it = deadlines_.begin(); it != deadlines_.end();) {
+      it = it->second == appender ? deadlines_.erase(it) : std::next(it);
+    }
+    cond_fired_.wait(lock, [&]() { return firing_ != appender; });
+  }
+
+ private:
+  AppenderTimer() { std::thread([this]() { Run(); }).detach(); }
+  void Run() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+      if (deadlines_.empty()) {
+        cond_.wait(lock);
+        continue;
+      }
+      auto it = deadlines_.begin();
+      if (std::chrono::steady_clock::now() < it->first) {
+        cond_.wait_until(lock, it->first);
+        continue;
+      }
+      firing_ = it->second;
+      deadlines_.erase(it);
+      lock.unlock();
+      firing_->OnTimer();
+      lock.lock();
+      firing_ = nullptr;
+      cond_fired_.notify_all();
+    }
+  }
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::condition_variable cond_fired_;
+  std::multimap<std::chrono::steady_clock::time_point, FileLogAppender *> deadlines_;
+  FileLogAppender *firing_ = nullptr;
+};
+
 FileLogAppender::~FileLogAppender() {
-  if (is_async_ && async_log_writter_.joinable()) {
-    async_log_writter_.detach();
+  AppenderTimer::Get().Cancel(this);
+  if (mode_ == AsyncMode::RING_BUFFER || mode_ == AsyncMode::DEFERRED || mode_ == AsyncMode::BINARY) {
+    // the backend holds raw pointers to this sink until it has drained them,
+    // one that is already destroyed drained everything on its way out
+    if (auto *backend = AsyncBackend::Running()) {
+      auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(queue_options_.shutdown_timeout_ms);
+      if (!backend->Flush(deadline)) {
+        // out of time: the backend still has to pass this sink's records, but now drops them
+        abandon_queue_.store(true, std::memory_order_relaxed);
+        backend->Flush();
+      }
+    }
+    std::lock_guard guard(file_mutex_);
+    EndRepeats();
+  }
+  if (mode_ == AsyncMode::BLOCK_DEQUE && async_log_writter_.joinable()) {
+    // the writer uses this appender: it writes what is queued, until the timeout
+    // makes it drop the rest, and stops once the closed deque is empty
+    log_string_buf_->Close();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(queue_options_.shutdown_timeout_ms);
+    while (block_deque_done_.load(std::memory_order_acquire) < block_deque_pushed_.load(std::memory_order_relaxed) &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    abandon_queue_.store(true, std::memory_order_relaxed);
+    async_log_writter_.join();
+  }
+  if (flush_policy_.fsync != FsyncPolicy::NO_FSYNC) {
+    file_.Sync();
   }
 }
 
@@ -127,6 +541,9 @@ auto LogAppenderBase::GetFormatter() -> Formatter::SharedPtr {
 void LogAppenderBase::SetLevel(LogLevel::Level level) {
   auto guard = std::unique_lock(shared_mutex_);
   level_ = level;
+  for (auto *it : owners_) {
+    it->UpdateLevel();
+  }
 }
 
 auto LogAppenderBase::GetLevel() -> LogLevel::Level {
@@ -134,80 +551,619 @@ auto LogAppenderBase::GetLevel() -> LogLevel::Level {
   return level_;
 }
 
+auto LogAppenderBase::GetStats() -> AppenderStats {
+  AppenderStats stats;
+  stats.name = GetName();
+  stats.events = metrics_.events.Load();
+  stats.bytes = metrics_.bytes.Load();
+  stats.drops = GetDropped();
+  stats.queue_high_watermark = metrics_.queue_high_watermark.load(std::memory_order_relaxed);
+  stats.blocked_ns = metrics_.blocked_ns.Load();
+  stats.batch_size = metrics_.batch_size.Load();
+  stats.write_ns = metrics_.write_ns.Load();
+  return stats;
+}
+
 FileLogAppender::FileLogAppender(std::string file_name, const bool is_async)
-    : is_async_(is_async), file_name_(std::move(file_name)) {
-  if (file_stream_.is_open()) {
-    file_stream_.close();
+    : FileLogAppender(std::move(file_name), is_async ? AsyncMode::RING_BUFFER : AsyncMode::SYNC) {}
+
+FileLogAppender::FileLogAppender(std::string file_name, AsyncMode mode)
+    : FileLogAppender(std::move(file_name), mode, QueueOptions()) {}
+
+FileLogAppender::FileLogAppender(std::string file_name, AsyncMode mode, const QueueOptions &queue_options)
+    : mode_(mode), file_name_(std::move(file_name)), queue_options_(queue_options) {
+  file_.Open(file_name_, true);
+  if (mode_ == AsyncMode::BINARY) {
+    binary_writer_ = std::make_unique<binary_log::Writer>();
+    binary_writer_->Begin(file_, Clock::StartNs());
   }
-  file_stream_.open(file_name_);
-  if (is_async) {
+  if (mode_ == AsyncMode::BLOCK_DEQUE) {
     log_string_buf_ = std::make_unique<BlockDeque<std::string>>();
     async_log_writter_ = std::thread([&]() {
-      std::string str;
-      while (log_string_buf_->pop(str)) {
-        file_stream_ << str;
+      // one lock per batch on the deque and one writev per batch on the file
+      std::deque<std::string> batch;
+      std::vector<struct iovec> iov;
+      while (log_string_buf_->pop_all(batch)) {
+        if (abandon_queue_.load(std::memory_order_relaxed)) {
+          // the destructor ran out of time
+          for (size_t i = 0; i < batch.size(); i++) {
+            Dropped();
+          }
+          block_deque_done_.fetch_add(batch.size(), std::memory_order_release);
+          continue;
+        }
+        iov.clear();
+        uint64_t queued = 0;
+        for (auto &str : batch) {
+          queued += str.size();
+          if (Dequeue(str.size())) {
+            iov.push_back({str.data(), str.size()});
+            metrics_.Written(str.size());
+          }
+        }
+        metrics_.Queued(queued);
+        std::lock_guard guard(file_mutex_);
+        auto start = std::chrono::steady_clock::now();
+        file_.WriteV(iov.data(), iov.size());
+        ReportDrops();
+        file_.Flush();
+        metrics_.write_ns.Record(AppenderMetrics::Since(start));
+        metrics_.batch_size.Record(iov.size());
+        block_deque_done_.fetch_add(batch.size(), std::memory_order_release);
       }
     });
   }
 }
 
-FileLogAppender::FileLogAppender(const std::string &file_name) : FileLogAppender(file_name, false) {}
+FileLogAppender::FileLogAppender(const std::string &file_name) : FileLogAppender(file_name, AsyncMode::SYNC) {}
+
+auto FileLogAppender::HasRoom(size_t len) const -> bool {
+  if (queue_options_.capacity_bytes == 0 || queue_options_.policy == OverflowPolicy::DROP_OLDEST) {
+    return true;
+  }
+  auto queued = queued_bytes_.load(std::memory_order_relaxed);
+  // a record larger than the capacity still goes through an empty queue
+  return queued <= 0 || static_cast<size_t>(queued) + len <= queue_options_.capacity_bytes;
+}
+
+template <typename Ready>
+auto FileLogAppender::WaitFor(LogLevel::Level level, Ready &&ready) -> bool {
+  if (ready()) {
+    return true;
+  }
+  auto policy = queue_options_.policy;
+  if (policy == OverflowPolicy::DROP_NEWEST || (policy == OverflowPolicy::KEEP_WARN && level < LogLevel::WARN)) {
+    return false;
+  }
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::milliseconds(queue_options_.block_timeout_ms);
+  while (!ready()) {
+    if (policy == OverflowPolicy::BLOCK_TIMEOUT && std::chrono::steady_clock::now() >= deadline) {
+      metrics_.blocked_ns.Record(AppenderMetrics::Since(start));
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  metrics_.blocked_ns.Record(AppenderMetrics::Since(start));
+  return true;
+}
+
+auto FileLogAppender::Dequeue(size_t len) -> bool {
+  if (queue_options_.capacity_bytes == 0) {
+    return true;
+  }
+  auto queued = queued_bytes_.fetch_sub(static_cast<int64_t>(len), std::memory_order_relaxed);
+  if (queue_options_.policy == OverflowPolicy::DROP_OLDEST && queued > 0 &&
+      static_cast<size_t>(queued) > queue_options_.capacity_bytes) {
+    Dropped();
+    return false;
+  }
+  return true;
+}
+
+void FileLogAppender::Dropped() {
+  dropped_.fetch_add(1, std::memory_order_relaxed);
+  unreported_drops_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FileLogAppender::ReportDrops() {
+  if (unreported_drops_.load(std::memory_order_relaxed) == 0 || !HasRoom(0)) {
+    return;
+  }
+  auto dropped = unreported_drops_.exchange(0, std::memory_order_relaxed);
+  static constexpr LogSite site{__FILE__, __LINE__, nullptr};
+  static const std::string logger_name = "easylog";
+  static const std::string thread_name;
+  LogEvent event(site, Clock::Now(), LogEvent::kElapseFromTime, GetThreadId(), thread_name, GetFiberId(),
+                 logger_name, LogLevel::Level::WARN);
+  event.GetStringStream() << dropped << " messages dropped";
+  WriteOwnEvent(event);
+}
+
+auto FileLogAppender::Repeated(uint64_t hash, const DeferredRecord &record, std::string_view thread_name) -> bool {
+  auto time = Clock::ToNs(record.time);
+  if (repeats_.site != nullptr && hash == repeats_.hash && time < repeats_.until_ns) {
+    // the timer writes the count once the window is over, should nothing else end the run
+    if (repeats_.count++ == 0) {
+      AppenderTimer::Get().Schedule(
+          this, std::chrono::steady_clock::now() + std::chrono::nanoseconds(repeats_.until_ns - time));
+    }
+    repeats_.stamp = record.time;
+    return true;
+  }
+  EndRepeats();
+  repeats_.hash = hash;
+  repeats_.until_ns = time + uint64_t(dedup_window_ms_.load(std::memory_order_relaxed)) * 1000000;
+  repeats_.site = record.site;
+  repeats_.logger_name = record.logger_name;
+  repeats_.level = record.level;
+  repeats_.thread_id = record.thread_id;
+  repeats_.fiber_id = record.fiber_id;
+  repeats_.thread_name.assign(thread_name);
+  return false;
+}
+
+auto FileLogAppender::SetDedupWindow(uint32_t window_ms) -> bool {
+  if (mode_ != AsyncMode::DEFERRED && mode_ != AsyncMode::BINARY) {
+    return false;
+  }
+  dedup_window_ms_.store(window_ms, std::memory_order_relaxed);
+  return true;
+}
+
+void FileLogAppender::EndRepeats() {
+  if (repeats_.count > 0) {
+    LogEvent event(*repeats_.site, repeats_.stamp, LogEvent::kElapseFromTime, repeats_.thread_id,
+                   repeats_.thread_name, repeats_.fiber_id, *repeats_.logger_name, repeats_.level);
+    event.GetStringStream() << "last message repeated " << repeats_.count << " times";
+    WriteOwnEvent(event);
+  }
+  repeats_.count = 0;
+  repeats_.site = nullptr;
+}
+
+void FileLogAppender::WriteOwnEvent(const LogEvent &event) {
+  auto appended = file_.Appended();
+  if (mode_ == AsyncMode::BINARY) {
+    binary_writer_->Append(file_, event.GetSite(), event.GetLoggerName(), event.GetThreadName(), event.GetTime(),
+                           event.GetThreadId(), event.GetFiberId(), event.GetLevel(), false, event.GetContent(), {});
+  } else {
+    LineBuffer line_buf;
+    GetFormatter()->Format(line_buf, event.GetLevel(), event);
+    auto line = line_buf.View();
+    file_.sputn(line.data(), static_cast<std::streamsize>(line.size()));
+  }
+  metrics_.Written(file_.Appended() - appended);
+}
+
+void FileLogAppender::SetFlushPolicy(const FlushPolicy &policy) {
+  std::lock_guard guard(file_mutex_);
+  flush_policy_ = policy;
+  file_.SetCapacity(policy.max_bytes);
+}
+
+void FileLogAppender::Flush() { FlushUntil(std::chrono::steady_clock::time_point::max()); }
+
+auto FileLogAppender::FlushUntil(std::chrono::steady_clock::time_point deadline) -> bool {
+  if (mode_ == AsyncMode::RING_BUFFER || mode_ == AsyncMode::DEFERRED || mode_ == AsyncMode::BINARY) {
+    // the backend flushes the file after each batch
+    if (auto *backend = AsyncBackend::Running(); backend != nullptr && !backend->Flush(deadline)) {
+      return false;
+    }
+    std::lock_guard guard(file_mutex_);
+    if (repeats_.count > 0) {
+      EndRepeats();
+      WriteOut(flush_policy_.fsync != FsyncPolicy::NO_FSYNC);
+    }
+    return true;
+  }
+  // the deque is FIFO: once as many lines are done as were pushed before this
+  // call, every line pushed before it is among them, later ones do not hold it up
+  auto target = block_deque_pushed_.load(std::memory_order_relaxed);
+  while (block_deque_done_.load(std::memory_order_acquire) < target) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  std::lock_guard guard(file_mutex_);
+  WriteOut(flush_policy_.fsync != FsyncPolicy::NO_FSYNC);
+  return true;
+}
+
+auto FileLogAppender::Reopen() -> bool {
+  if (mode_ == AsyncMode::RING_BUFFER || mode_ == AsyncMode::DEFERRED || mode_ == AsyncMode::BINARY) {
+    Flush();
+  }
+  std::lock_guard guard(file_mutex_);
+  if (!file_.Open(file_name_)) {
+    return false;
+  }
+  // the records that follow only refer to dictionary entries written to the new file
+  if (mode_ == AsyncMode::BINARY) {
+    binary_writer_->Begin(file_, Clock::StartNs());
+  }
+  return true;
+}
+
+void FileLogAppender::Log(LogLevel::Level level, const LogEvent &event) {
+  if (level < level_) {
+    return;
+  }
+  switch (mode_) {
+    case AsyncMode::RING_BUFFER: {
+      thread_local LineBuffer line_buf;
+      line_buf.Clear();
+      formatter_->Format(line_buf, level, event);
+      auto line = line_buf.View();
+      // a record too large for the ring is dropped, never cut
+      if (!AsyncBackend::Fits(line.size()) || !WaitFor(level, [&]() { return HasRoom(line.size()); }) ||
+          !WaitFor(level, [&]() { return AsyncBackend::Get().TryPush(this, event.GetStamp(), {line}); })) {
+        Dropped();
+        break;
+      }
+      if (queue_options_.capacity_bytes > 0) {
+        queued_bytes_.fetch_add(static_cast<int64_t>(line.size()), std::memory_order_relaxed);
+      }
+      break;
+    }
+    case AsyncMode::DEFERRED:
+    case AsyncMode::BINARY: {
+      // the raw stamp travels, the backend converts it
+      DeferredRecord record{&event.GetSite(), &event.GetLoggerName(), event.GetStamp(), event.GetRawElapse(),
+                            event.GetThreadId(), event.GetFiberId(), level, 0, 0, false, 0};
+      std::string_view payload;
+      // arguments captured for the site's own format travel raw, anything else as text
+      if (event.GetFormat() != nullptr && event.GetFormat() == event.GetSite().format) {
+        record.has_args = true;
+        payload = event.GetArgs();
+      } else {
+        payload = event.GetContent();
+      }
+      record.thread_name_len = static_cast<uint32_t>(event.GetThreadName().size());
+      record.payload_len = static_cast<uint32_t>(payload.size());
+      auto fields = event.GetFields();
+      record.fields_len = static_cast<uint32_t>(fields.size());
+      std::string_view record_bytes(reinterpret_cast<const char *>(&record), sizeof(record));
+      auto record_len = sizeof(record) + record.thread_name_len + payload.size() + fields.size();
+      // cutting a record would cut its packed arguments, one too large for the ring is dropped
+      if (!AsyncBackend::Fits(record_len) || !WaitFor(level, [&]() { return HasRoom(record_len); }) ||
+          !WaitFor(level, [&]() {
+            return AsyncBackend::Get().TryPush(this, record.time,
+                                               {record_bytes, event.GetThreadName(), payload, fields});
+          })) {
+        Dropped();
+        break;
+      }
+      if (queue_options_.capacity_bytes > 0) {
+        queued_bytes_.fetch_add(static_cast<int64_t>(record_len), std::memory_order_relaxed);
+      }
+      break;
+    }
+    case AsyncMode::BLOCK_DEQUE: {
+      thread_local LineBuffer line_buf;
+      line_buf.Clear();
+      formatter_->Format(line_buf, level, event);
+      std::string line(line_buf.View());
+      if (!WaitFor(level, [&]() { return HasRoom(line.size()); })) {
+        Dropped();
+        break;
+      }
+      if (queue_options_.capacity_bytes > 0) {
+        queued_bytes_.fetch_add(static_cast<int64_t>(line.size()), std::memory_order_relaxed);
+      }
+      block_deque_pushed_.fetch_add(1, std::memory_order_relaxed);
+      if (queue_options_.policy == OverflowPolicy::BLOCK || queue_options_.policy == OverflowPolicy::DROP_OLDEST) {
+        // sleep on the deque instead of polling it
+        if (!log_string_buf_->try_push_back(line)) {
+          auto start = std::chrono::steady_clock::now();
+          log_string_buf_->push_back(line);
+          metrics_.blocked_ns.Record(AppenderMetrics::Since(start));
+        }
+      } else if (!WaitFor(level, [&]() { return log_string_buf_->try_push_back(line); })) {
+        block_deque_done_.fetch_add(1, std::memory_order_relaxed);
+        if (queue_options_.capacity_bytes > 0) {
+          queued_bytes_.fetch_sub(static_cast<int64_t>(line.size()), std::memory_order_relaxed);
+        }
+        Dropped();
+      }
+      break;
+    }
+    default: {
+      thread_local LineBuffer line_buf;
+      line_buf.Clear();
+      formatter_->Format(line_buf, level, event);
+      auto line = line_buf.View();
+      auto time = event.GetTime();
+      std::lock_guard guard(file_mutex_);
+      bool first = file_.Buffered() == 0;
+      if (first) {
+        first_buffered_time_ = time;
+      }
+      file_.sputn(line.data(), static_cast<std::streamsize>(line.size()));
+      metrics_.Written(line.size());
+      ++buffered_events_;
+      bool urgent = level >= flush_policy_.flush_level;
+      if (urgent || file_.Buffered() >= flush_policy_.max_bytes ||
+          time >= first_buffered_time_ + uint64_t(flush_policy_.max_delay_ms) * 1000000) {
+        WriteOut(flush_policy_.fsync == FsyncPolicy::FSYNC_ON_FLUSH ||
+                 (urgent && flush_policy_.fsync == FsyncPolicy::FSYNC_ON_LEVEL));
+      } else if (first) {
+        // written by the timer if no later event does it first
+        AppenderTimer::Get().Schedule(
+            this, std::chrono::steady_clock::now() + std::chrono::milliseconds(flush_policy_.max_delay_ms));
+      }
+    }
+  }
+}
 
-auto FileLogAppender::ReopenFile() -> bool {
-  if (file_stream_.is_open()) {
-    file_stream_.close();
+void FileLogAppender::OnTimer() {
+  std::lock_guard guard(file_mutex_);
+  auto now = Clock::ToNs(Clock::Now());
+  // the buffered lines of the SYNC mode or the count of a run of repeats
+  uint64_t due;
+  if (mode_ == AsyncMode::SYNC && file_.Buffered() > 0) {
+    due = first_buffered_time_ + uint64_t(flush_policy_.max_delay_ms) * 1000000;
+  } else if (repeats_.count > 0) {
+    due = repeats_.until_ns;
+  } else {
+    return;
+  }
+  if (now < due) {
+    AppenderTimer::Get().Schedule(this, std::chrono::steady_clock::now() + std::chrono::nanoseconds(due - now));
+    return;
   }
-  file_stream_.open(file_name_, std::ios_base::app);
-  return file_stream_.is_open();
+  EndRepeats();
+  WriteOut(flush_policy_.fsync == FsyncPolicy::FSYNC_ON_FLUSH);
+}
+
+// identifies a deferred record for duplicate suppression: site, logger, level and the message as queued
+static auto RecordHash(const DeferredRecord &record, std::string_view payload, std::string_view fields) -> uint64_t {
+  uint64_t hash = std::hash<std::string_view>()(payload);
+  auto mix = [&hash](uint64_t value) { hash ^= value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2); };
+  mix(std::hash<std::string_view>()(fields));
+  mix(reinterpret_cast<uintptr_t>(record.site));
+  mix(reinterpret_cast<uintptr_t>(record.logger_name));
+  mix(record.level * 2 + record.has_args);
+  return hash;
 }
 
-void FileLogAppender::Log(LogLevel::Level level, LogEvent::SharedPtr event) {
-  if (is_async_) {
-    std::stringstream temp_buf;
-    if (level >= level_) {
-      formatter_->Format(temp_buf, level, event);
+void FileLogAppender::Consume(const char *data, size_t len) {
+  if (abandon_queue_.load(std::memory_order_relaxed)) {
+    // the destructor ran out of time
+    Dropped();
+    return;
+  }
+  if (!Dequeue(len)) {
+    std::lock_guard guard(file_mutex_);
+    batch_bytes_ += len;
+    return;
+  }
+  if (mode_ != AsyncMode::DEFERRED && mode_ != AsyncMode::BINARY) {
+    std::lock_guard guard(file_mutex_);
+    batch_bytes_ += len;
+    ++buffered_events_;
+    file_.sputn(data, static_cast<std::streamsize>(len));
+    metrics_.Written(len);
+    return;
+  }
+  DeferredRecord record;
+  if (len < sizeof(record)) {
+    return;
+  }
+  memcpy(&record, data, sizeof(record));
+  std::string_view rest(data + sizeof(record), len - sizeof(record));
+  // per backend worker, reused for every record
+  thread_local std::string thread_name;
+  thread_name.assign(rest.substr(0, record.thread_name_len));
+  rest.remove_prefix(std::min<size_t>(record.thread_name_len, rest.size()));
+  auto payload = rest.substr(0, record.payload_len);
+  rest.remove_prefix(std::min<size_t>(record.payload_len, rest.size()));
+  auto fields = rest.substr(0, record.fields_len);
+  std::unique_lock lock(file_mutex_, std::defer_lock);
+  if (dedup_window_ms_.load(std::memory_order_relaxed) > 0) {
+    auto hash = RecordHash(record, payload, fields);
+    // checked and written in one critical section, so what is written agrees with the run
+    lock.lock();
+    if (Repeated(hash, record, thread_name)) {
+      batch_bytes_ += len;
+      return;
+    }
+  }
+  if (mode_ == AsyncMode::BINARY) {
+    if (!lock.owns_lock()) {
+      lock.lock();
     }
-    log_string_buf_->push_back(temp_buf.str());
+    batch_bytes_ += len;
+    ++buffered_events_;
+    auto appended = file_.Appended();
+    binary_writer_->Append(file_, *record.site, *record.logger_name, thread_name, Clock::ToNs(record.time),
+                           record.thread_id, record.fiber_id, record.level, record.has_args, payload, fields);
+    metrics_.Written(file_.Appended() - appended);
+    return;
+  }
+  // formatted outside the lock unless deduplicating, so Flush and Reopen only wait for the write
+  thread_local std::unique_ptr<LogEvent> event;
+  if (event == nullptr) {
+    event = std::make_unique<LogEvent>(*record.site, record.time, record.elapse, record.thread_id, thread_name,
+                                       record.fiber_id, *record.logger_name, record.level);
+  } else {
+    event->Reset(*record.site, record.time, record.elapse, record.thread_id, thread_name, record.fiber_id,
+                 *record.logger_name, record.level);
+  }
+  if (record.has_args) {
+    event->SetArgs(record.site->format, payload, record.site->braces);
+  } else {
+    event->GetStringStream().write(payload.data(), static_cast<std::streamsize>(payload.size()));
+  }
+  event->SetFields(fields);
+  thread_local LineBuffer line_buf;
+  line_buf.Clear();
+  GetFormatter()->Format(line_buf, record.level, *event);
+  auto line = line_buf.View();
+  if (!lock.owns_lock()) {
+    lock.lock();
+  }
+  batch_bytes_ += len;
+  ++buffered_events_;
+  file_.sputn(line.data(), static_cast<std::streamsize>(line.size()));
+  metrics_.Written(line.size());
+}
+
+void FileLogAppender::EndBatch() {
+  std::lock_guard guard(file_mutex_);
+  metrics_.Queued(batch_bytes_);
+  batch_bytes_ = 0;
+  ReportDrops();
+  WriteOut(flush_policy_.fsync == FsyncPolicy::FSYNC_ON_FLUSH);
+}
+
+void FileLogAppender::CrashFlush() {
+  // the mutex may be held by the crashed thread, the buffer is consistent up to its write position anyway
+  file_.Flush();
+  if (mode_ == AsyncMode::BLOCK_DEQUE) {
+    log_string_buf_->try_for_each([this](const std::string &line) {
+      file_.sputn(line.data(), static_cast<std::streamsize>(line.size()));
+    });
+    file_.Flush();
+  }
+}
+
+void FileLogAppender::CrashConsume(const char *data, size_t len) {
+  // records of the other modes need the formatter, which may allocate
+  if (mode_ == AsyncMode::RING_BUFFER) {
+    file_.sputn(data, static_cast<std::streamsize>(len));
+    file_.Flush();
+  }
+}
+
+void FileLogAppender::WriteOut(bool sync) {
+  auto start = std::chrono::steady_clock::now();
+  if (sync) {
+    file_.Sync();
   } else {
-    ReopenFile();
-    if (level >= level_) {
-      formatter_->Format(file_stream_, level, event);
+    file_.Flush();
+  }
+  if (buffered_events_ > 0) {
+    metrics_.write_ns.Record(AppenderMetrics::Since(start));
+    metrics_.batch_size.Record(buffered_events_);
+    buffered_events_ = 0;
+  }
+}
+
+// write(2) all of `data`, retrying short writes
+static void WriteFully(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    auto n = write(fd, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
     }
+    data += n;
+    len -= n;
   }
 }
 
-void ConsoleLogAppender::Log(LogLevel::Level level, LogEvent::SharedPtr event) {
-  if (level >= level_) {
+ConsoleLogAppender::ConsoleLogAppender(bool async) : async_(async), colored_(isatty(STDOUT_FILENO) == 1) {}
+
+ConsoleLogAppender::~ConsoleLogAppender() {
+  // the backend holds raw pointers to this sink until it has drained them
+  Flush();
+}
+
+void ConsoleLogAppender::Flush() { FlushUntil(std::chrono::steady_clock::time_point::max()); }
+
+auto ConsoleLogAppender::FlushUntil(std::chrono::steady_clock::time_point deadline) -> bool {
+  auto *backend = AsyncBackend::Running();
+  return !async_ || backend == nullptr || backend->Flush(deadline);
+}
+
+void ConsoleLogAppender::CrashFlush() { WriteFully(STDOUT_FILENO, batch_.data(), batch_.size()); }
+
+void ConsoleLogAppender::CrashConsume(const char *data, size_t len) { WriteFully(STDOUT_FILENO, data, len); }
+
+void ConsoleLogAppender::Log(LogLevel::Level level, const LogEvent &event) {
+  if (level < level_) {
+    return;
+  }
+  thread_local LineBuffer line_buf;
+  line_buf.Clear();
+  bool colored = colored_.load(std::memory_order_relaxed);
+  if (colored) {
     switch (level) {
       case LogLevel::Level::DEBUG:
-        std::cout << "\033[1;32m";
+        line_buf.sputn("\033[1;32m", 7);
         break;
       case LogLevel::Level::INFO:
-        std::cout << "\033[1;36m";
+        line_buf.sputn("\033[1;36m", 7);
         break;
       case LogLevel::Level::WARN:
-        std::cout << "\033[1;33m";
+        line_buf.sputn("\033[1;33m", 7);
         break;
       case LogLevel::Level::ERROR:
-        std::cout << "\033[1;31m";
+        line_buf.sputn("\033[1;31m", 7);
         break;
       case LogLevel::Level::FATAL:
-        std::cout << "\033[1;41m";
+        line_buf.sputn("\033[1;41m", 7);
         break;
       default:
         break;
     }
-    formatter_->Format(std::cout, level, event);
-    std::cout << "\033[0m";
   }
+  formatter_->Format(line_buf, level, event);
+  if (colored) {
+    line_buf.sputn("\033[0m", 4);
+  }
+  auto line = line_buf.View();
+  // a line too large for the ring is written by the caller, like a synchronous one
+  if (async_ && AsyncBackend::Fits(line.size())) {
+    if (!AsyncBackend::Get().TryPush(this, event.GetStamp(), {line})) {
+      auto start = std::chrono::steady_clock::now();
+      AsyncBackend::Get().Push(this, event.GetStamp(), line.data(), line.size());
+      metrics_.blocked_ns.Record(AppenderMetrics::Since(start));
+    }
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  WriteFully(STDOUT_FILENO, line.data(), line.size());
+  metrics_.write_ns.Record(AppenderMetrics::Since(start));
+  metrics_.batch_size.Record(1);
+  metrics_.Written(line.size());
+}
+
+void ConsoleLogAppender::Consume(const char *data, size_t len) {
+  std::lock_guard guard(batch_mutex_);
+  batch_.append(data, len);
+  ++batch_events_;
+  metrics_.Written(len);
+  if (batch_.size() >= FileWriter::kDefaultCapacity) {
+    WriteBatch();
+  }
+}
+
+void ConsoleLogAppender::EndBatch() {
+  std::lock_guard guard(batch_mutex_);
+  WriteBatch();
+}
+
+void ConsoleLogAppender::WriteBatch() {
+  metrics_.Queued(batch_.size());
+  auto start = std::chrono::steady_clock::now();
+  WriteFully(STDOUT_FILENO, batch_.data(), batch_.size());
+  metrics_.write_ns.Record(AppenderMetrics::Since(start));
+  metrics_.batch_size.Record(batch_events_);
+  batch_.clear();
+  batch_events_ = 0;
 }
 
 class ContentFormatItem : public Formatter::FormatItemBase {
  public:
   // In order to use map to init, `str` never used
   explicit ContentFormatItem(const std::string &str = "") {}
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override {
-    os << event->GetContent();
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
+    os << event.GetContent();
   }  // namespace xac
 };
 
@@ -215,8 +1171,8 @@ class FileNameFormatItem : public Formatter::FormatItemBase {
  public:
   // In order to use map to init, `str` never used
   explicit FileNameFormatItem(const std::string &str = "") {}
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override {
-    os << event->GetFileName();
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
+    os << event.GetFileName();
   }
 };
 
@@ -224,16 +1180,12 @@ class TimeFormatItem : public Formatter::FormatItemBase {
  public:
   explicit TimeFormatItem(std::string time_format) : time_format_(std::move(time_format)) {
     if (time_format_.empty()) {
-      time_format_ = "%Y-%m-%d %H:%M:%S";
+      time_format_ = kDefaultTimeFormat;
     }
   }
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override {
-    struct tm tm_struct;
-    auto time = static_cast<time_t>(event->GetTime());
-    localtime_r(&time, &tm_struct);
-    char buf[64];
-    strftime(buf, sizeof(buf), time_format_.c_str(), &tm_struct);
-    os << buf;
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
+    char buf[128];
+    os.write(buf, static_cast<std::streamsize>(FormatTime(time_format_, event.GetTime(), buf, sizeof(buf))));
   }
 
  private:
@@ -244,8 +1196,8 @@ class ElapseFormatItem : public Formatter::FormatItemBase {
  public:
   // In order to use map to init, `str` never used
   explicit ElapseFormatItem(const std::string &str = "") {}
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override {
-    os << event->GetFileName();
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
+    os << event.GetElapse();
   }
 };
 
@@ -253,8 +1205,8 @@ class LineFormatItem : public Formatter::FormatItemBase {
  public:
   // In order to use map to init, `str` never used
   explicit LineFormatItem(const std::string &str = "") {}
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override {
-    os << event->GetLine();
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
+    os << event.GetLine();
   }
 };
 
@@ -262,8 +1214,8 @@ class ThreadIdFormatItem : public Formatter::FormatItemBase {
  public:
   // In order to use map to init, `str` never used
   explicit ThreadIdFormatItem(const std::string &str = "") {}
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override {
-    os << event->GetThreadId();
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
+    os << event.GetThreadId();
   }
 };
 
@@ -271,8 +1223,8 @@ class ThreadNameFormatItem : public Formatter::FormatItemBase {
  public:
   // In order to use map to init, `str` never used
   explicit ThreadNameFormatItem(const std::string &str = "") {}
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override {
-    os << event->GetThreadName();
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
+    os << event.GetThreadName();
   }
 };
 
@@ -280,15 +1232,15 @@ class FiberIdFormatItem : public Formatter::FormatItemBase {
  public:
   // In order to use map to init, `str` never used
   explicit FiberIdFormatItem(const std::string &str = "") {}
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override {
-    os << event->GetFiberId();
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
+    os << event.GetFiberId();
   }
 };
 
 class StringFormatItem : public Formatter::FormatItemBase {
  public:
   explicit StringFormatItem(const std::string &string_content = "") : string_content_(string_content) {}
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override {
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
     os << string_content_;
   }
 
@@ -300,7 +1252,7 @@ class LevelFormatItem : public Formatter::FormatItemBase {
  public:
   // In order to use map to init, `str` never used
   explicit LevelFormatItem(const std::string &str = "") {}
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override {
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
     os << LogLevel::ToString(level);
   }
 };
@@ -309,8 +1261,8 @@ class LoggerNameFormatItem : public Formatter::FormatItemBase {
  public:
   // In order to use map to init, `str` never used
   explicit LoggerNameFormatItem(const std::string &str = "") {}
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override {
-    os << event->GetLoggerName();
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
+    os << event.GetLoggerName();
   }
 };
 
@@ -318,155 +1270,364 @@ class NewLineFormatItem : public Formatter::FormatItemBase {
  public:
   // In order to use map to init, `str` never used
   explicit NewLineFormatItem(const std::string &str = "") {}
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override { os << std::endl; }
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override { os << '\n'; }
 };
 
 class TabFormatItem : public Formatter::FormatItemBase {
  public:
   // In order to use map to init, `str` never used
   explicit TabFormatItem(const std::string &str = "") {}
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) override { os << "  "; }
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override { os << "  "; }
 };
 
-void Formatter::PatternParse() {
-  // std::cout << "-----------start parse-----------" << std::endl;
-  //  item: FormatItemBase, the character after %
-  //  fmt: the parameter of FormatItemBase's Constructor, which is the character
-  //  in {} type: 0 for StringItem, 1 for others
-  std::vector<std::tuple<std::string /*item*/, std::string /*format*/, int /*type*/>> pattern_parsed;
-  std::string content_str;  // not the formatted string, just content
-  for (auto str_left = pattern_.begin(); str_left != pattern_.end();) {
-    // char, have not met escape
-    if (*str_left != '%') {
-      content_str += *str_left;
-      ++str_left;
-      continue;
-    }
-    // met escape
-    if ((++str_left != pattern_.end()) && *str_left == '%') {  // if %%
-      content_str += *str_left;
-      continue;
-    }
-    auto str_right = str_left;
-    std::string item_str;         // the string after % before {
-    std::string item_format_str;  // the string in {}
-    int parse_state = 0;          // 0 means parsing item, 1 means parsing fmt
-    while (str_left != pattern_.end()) {
-      // parse item
-      if (parse_state == 0) {
-        if (!isalpha(*str_right) && *str_right != '{' &&
-            *str_right != '}') {  // current item has been parsed, get to next
-          item_str = std::string(str_left, str_right);
-          str_left = str_right;
-          break;
-        }
-        if (*str_right == '{') {
-          item_str = std::string(str_left, str_right);
-          str_left = ++str_right;
-          parse_state = 1;  // start parsing fmt
-        }
-      }
-      // parse fmt
-      if (parse_state == 1 && *str_right == '}') {
-        item_format_str = std::string(str_left, str_right);
-        str_left = str_right + 1;
-        parse_state = 0;  // end parsing fmt
-        break;
-      }
-      ++str_right;
-      // last item
-      if (str_right == pattern_.end() && item_str.empty()) {
-        item_str = std::string(str_left, str_right);
-        str_left = str_right;
-      }
-    }
-    if (parse_state == 1 || item_str.empty()) {  // error item
-    }
-    if (!content_str.empty()) {
-      pattern_parsed.emplace_back(content_str, "", 0);
-      content_str.clear();
-    }
-    pattern_parsed.emplace_back(item_str, item_format_str, 1);
-    item_str.clear();
-    item_format_str.clear();
+class JsonFormatItem : public Formatter::FormatItemBase {
+ public:
+  explicit JsonFormatItem(std::string time_format) : time_format_(std::move(time_format)) {}
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
+    thread_local LineBuffer line_buf;
+    line_buf.Clear();
+    Formatter::FormatJson(time_format_, line_buf, level, event);
+    os << line_buf.View();
   }
-  if (!content_str.empty()) {
-    pattern_parsed.emplace_back(content_str, "", 0);
+
+ private:
+  std::string time_format_;
+};
+
+class FieldsFormatItem : public Formatter::FormatItemBase {
+ public:
+  // In order to use map to init, `str` never used
+  explicit FieldsFormatItem(const std::string &str = "") {}
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) override {
+    thread_local LineBuffer line_buf;
+    line_buf.Clear();
+    Formatter::FormatFields(line_buf, event);
+    os << line_buf.View();
   }
-  // static map from char to item constructor
-  static std::map<std::string, std::function<FormatItemBase::SharedPtr(const std::string &)>> char_to_item_map = {
-#define XX(STR, CLASS)                                                                     \
-  {                                                                                        \
-#STR, [](const std::string &str) { return FormatItemBase::SharedPtr(new CLASS(str)); } \
+};
+
+void Formatter::PatternParse() {
+  format_program::Parse(pattern_, [this](const format_program::Instruction &ins) { program_.push_back(ins); });
+  // static map from instruction to item constructor
+  static std::map<format_program::Op, std::function<FormatItemBase::SharedPtr(const std::string &)>> op_to_item_map = {
+#define XX(OP, CLASS)                                                                              \
+  {                                                                                                \
+    format_program::Op::OP, [](const std::string &str) { return FormatItemBase::SharedPtr(new CLASS(str)); } \
   }
 
-      XX(m, ContentFormatItem),    XX(p, LevelFormatItem),      XX(r, ElapseFormatItem),
-      XX(c, LoggerNameFormatItem),  // logger name
-      XX(t, ThreadIdFormatItem),   XX(n, NewLineFormatItem),    XX(d, TimeFormatItem),
-      XX(f, FileNameFormatItem),   XX(l, LineFormatItem),       XX(T, TabFormatItem),
-      XX(F, FiberIdFormatItem),    XX(N, ThreadNameFormatItem),
+      XX(LITERAL, StringFormatItem),      XX(CONTENT, ContentFormatItem),   XX(LEVEL, LevelFormatItem),
+      XX(ELAPSE, ElapseFormatItem),       XX(LOGGER_NAME, LoggerNameFormatItem),
+      XX(THREAD_ID, ThreadIdFormatItem),  XX(NEW_LINE, NewLineFormatItem), XX(TIME, TimeFormatItem),
+      XX(FILE_NAME, FileNameFormatItem),  XX(LINE, LineFormatItem),         XX(TAB, TabFormatItem),
+      XX(FIBER_ID, FiberIdFormatItem),    XX(THREAD_NAME, ThreadNameFormatItem), XX(JSON, JsonFormatItem),
+      XX(FIELDS, FieldsFormatItem),
 #undef XX
   };
   // add to format_items
-  for (auto &i : pattern_parsed) {
-    if (std::get<2>(i) == 0) {
-      format_items_.push_back(FormatItemBase::SharedPtr(new StringFormatItem(std::get<0>(i))));
+  for (const auto &ins : program_) {
+    if (ins.op == format_program::Op::ERROR) {
+      format_items_.push_back(
+          FormatItemBase::SharedPtr(new StringFormatItem("<<error_format %" + std::string(ins.arg) + ">>")));
     } else {
-      auto it = char_to_item_map.find(std::get<0>(i));
-      if (it == char_to_item_map.end()) {
-        format_items_.push_back(
-            FormatItemBase::SharedPtr(new StringFormatItem("<<error_format %" + std::get<0>(i) + ">>")));
-      } else {
-        format_items_.push_back(it->second(std::get<1>(i)));
-      }
+      format_items_.push_back(op_to_item_map.at(ins.op)(std::string(ins.arg)));
     }
-    // std::cout << "(" << std::get<0>(i) << ") - (" << std::get<1>(i) << ") -
-    // (" << std::get<2>(i) << ")" << std::endl;
   }
-  // std::cout << "-----------end parse-----------" << std::endl;
 }
 
 auto LoggerManager::AddLogger(const std::shared_ptr<Logger> &logger) -> bool {
-  auto logger_name = logger->GetName();
-  if (loggers_.find(logger_name) == loggers_.end()) {
-    loggers_.insert(std::pair(logger_name, logger));
-    return true;
+  {
+    std::lock_guard guard(mutex_);
+    const auto &loggers = *loggers_.load(std::memory_order_relaxed);
+    auto it = loggers.find(logger->GetName());
+    if (it != loggers.end()) {
+      if (!it->second->implicit_) {
+        return false;
+      }
+      // replace the stand-in created for the name, keep the level it was given
+      if (logger->own_level_.load(std::memory_order_relaxed) == LogLevel::Level::UNKNOWN) {
+        logger->own_level_.store(it->second->own_level_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      }
+    }
+    auto next = std::make_unique<LoggerMap>(loggers);
+    (*next)[logger->GetName()] = logger;
+    Publish(std::move(next));
   }
-  return false;
+  rcu::Synchronize();
+  return true;
 }
 
 auto LoggerManager::DeleteLogger(const std::shared_ptr<Logger> &logger) -> bool {
-  auto logger_name = logger->GetName();
-  if (loggers_.find(logger_name) != loggers_.end()) {
-    loggers_.erase(logger_name);
-    return true;
-  }
-  return false;
+  return DeleteLogger(logger->GetName());
 }
 
 auto LoggerManager::DeleteLogger(const std::string &logger_name) -> bool {
-  if (loggers_.find(logger_name) != loggers_.end()) {
-    loggers_.erase(logger_name);
-    return true;
+  {
+    std::lock_guard guard(mutex_);
+    const auto &loggers = *loggers_.load(std::memory_order_relaxed);
+    if (loggers.find(logger_name) == loggers.end()) {
+      return false;
+    }
+    auto next = std::make_unique<LoggerMap>(loggers);
+    next->erase(logger_name);
+    Publish(std::move(next));
   }
-  return false;
+  rcu::Synchronize();
+  return true;
+}
+
+void LoggerManager::ClearLoggers() {
+  {
+    std::lock_guard guard(mutex_);
+    Publish(std::make_unique<LoggerMap>());
+  }
+  rcu::Synchronize();
+}
+
+void LoggerManager::SetLevel(const std::string &logger_name, LogLevel::Level level) {
+  {
+    std::lock_guard guard(mutex_);
+    FindOrCreate(logger_name)->own_level_.store(level, std::memory_order_relaxed);
+    UpdateLevels();
+  }
+  rcu::Synchronize();
 }
-void LoggerManager::ClearLoggers() { loggers_.clear(); }
-auto LoggerManager::GetLogger(const std::string &logger_name) -> const std::shared_ptr<Logger> & {
-  auto it = loggers_.find(logger_name);
-  if (it != loggers_.end()) {
+
+void LoggerManager::Publish(std::unique_ptr<LoggerMap> loggers) {
+  Relink(*loggers_.load(std::memory_order_relaxed), *loggers);
+  const auto *old = loggers_.exchange(loggers.release(), std::memory_order_acq_rel);
+  // cached handles resolve again, against the new map
+  generation_.fetch_add(1, std::memory_order_release);
+  UpdateLevels();
+  rcu::Retire([old] { delete old; });
+}
+
+auto LoggerManager::FindOrCreate(std::string_view logger_name) -> const std::shared_ptr<Logger> & {
+  const auto &loggers = *loggers_.load(std::memory_order_relaxed);
+  auto it = loggers.find(logger_name);
+  if (it != loggers.end()) {
     return it->second;
   }
-  LRERROR << "No logger named " << logger_name;
-  return root_logger_;
+  auto logger = std::make_shared<Logger>(std::string(logger_name), true);
+  logger->implicit_ = true;
+  auto next = std::make_unique<LoggerMap>(loggers);
+  // map nodes do not move, the reference stays valid in the published map
+  const auto &created = next->emplace(logger->GetName(), std::move(logger)).first->second;
+  Publish(std::move(next));
+  return created;
+}
+
+void LoggerManager::Relink(const LoggerMap &prev, const LoggerMap &next) {
+  for (const auto &[name, logger] : prev) {
+    auto it = next.find(name);
+    if (it == next.end() || it->second != logger) {
+      logger->registered_.store(false, std::memory_order_release);
+      logger->parent_.store(nullptr, std::memory_order_release);
+      logger->ComputeLevel();
+    }
+  }
+  for (const auto &[name, logger] : next) {
+    Logger *parent = nullptr;
+    if (logger != root_logger_) {
+      parent = root_logger_.get();
+      std::string_view ancestor = name;
+      for (auto dot = ancestor.rfind('.'); dot != std::string_view::npos; dot = ancestor.rfind('.')) {
+        ancestor = ancestor.substr(0, dot);
+        auto it = next.find(ancestor);
+        if (it != next.end()) {
+          parent = it->second.get();
+          break;
+        }
+      }
+    }
+    logger->parent_.store(parent, std::memory_order_release);
+    logger->registered_.store(true, std::memory_order_release);
+  }
+}
+
+void LoggerManager::UpdateLevels() {
+  root_logger_->ComputeLevel();
+  // an ancestor's name is a prefix of its descendants', so the map has parents first
+  for (const auto &[name, logger] : *loggers_.load(std::memory_order_relaxed)) {
+    if (logger != root_logger_) {
+      logger->ComputeLevel();
+    }
+  }
+}
+
+auto LoggerManager::GetLogger(const std::string &logger_name) -> std::shared_ptr<Logger> {
+  {
+    rcu::ReadGuard guard;
+    const auto &loggers = *loggers_.load(std::memory_order_acquire);
+    auto it = loggers.find(logger_name);
+    if (it != loggers.end()) {
+      return it->second;
+    }
+  }
+  std::lock_guard guard(mutex_);
+  return FindOrCreate(logger_name);
+}
+
+auto LoggerManager::FindLogger(std::string_view logger_name) -> Logger * {
+  const auto &loggers = *loggers_.load(std::memory_order_acquire);
+  auto it = loggers.find(logger_name);
+  if (it != loggers.end()) {
+    return it->second.get();
+  }
+  std::lock_guard guard(mutex_);
+  return FindOrCreate(logger_name).get();
+}
+
+auto LoggerManager::Resolve(std::string_view logger_name, LoggerHandle &handle) -> Logger * {
+  // under the writers' mutex a handle can not store a logger older than its generation
+  std::lock_guard guard(mutex_);
+  auto *logger = FindOrCreate(logger_name).get();
+  handle.logger_.store(logger, std::memory_order_relaxed);
+  handle.generation_.store(generation_.load(std::memory_order_relaxed), std::memory_order_release);
+  return logger;
+}
+
+void LoggerManager::Flush() {
+  // flushing may wait on the backend, so not inside the read section
+  std::vector<LogAppenderBase::SharedPtr> appenders;
+  {
+    rcu::ReadGuard guard;
+    for (const auto &[name, logger] : *loggers_.load(std::memory_order_acquire)) {
+      for (const auto &appender : *logger->log_appenders_.load(std::memory_order_acquire)) {
+        if (std::find(appenders.begin(), appenders.end(), appender) == appenders.end()) {
+          appenders.push_back(appender);
+        }
+      }
+    }
+  }
+  for (const auto &appender : appenders) {
+    appender->Flush();
+  }
+}
+
+void LoggerManager::CrashFlush() {
+  // no read section, it may allocate; the crashed process no longer changes the registry
+  auto *manager = instance_;
+  if (manager == nullptr) {
+    return;
+  }
+  for (const auto &[name, logger] : *manager->loggers_.load(std::memory_order_acquire)) {
+    for (const auto &appender : *logger->log_appenders_.load(std::memory_order_acquire)) {
+      appender->CrashFlush();
+    }
+  }
+  // after the buffers, the ring records are newer
+  if (auto *backend = AsyncBackend::Running()) {
+    backend->CrashDrain();
+  }
+}
+
+namespace {
+
+std::atomic<bool> crashing = false;
+
+void CrashHandler(int sig) {
+  if (!crashing.exchange(true)) {
+    LoggerManager::CrashFlush();
+  }
+  // SA_RESETHAND restored the default action
+  raise(sig);
+}
+
+}  // namespace
+
+void LoggerManager::InstallCrashHandler() {
+  struct sigaction action {};
+  action.sa_handler = CrashHandler;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESETHAND | SA_NODEFER;
+  for (int sig : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+    sigaction(sig, &action, nullptr);
+  }
+}
+
+auto LoggerManager::GetStats() -> std::vector<LoggerStats> {
+  std::vector<LoggerStats> stats;
+  rcu::ReadGuard guard;
+  for (const auto &[name, logger] : *loggers_.load(std::memory_order_acquire)) {
+    stats.push_back(logger->GetStats());
+  }
+  return stats;
+}
+
+void LoggerManager::SetBackendOptions(const AsyncBackend::Options &options) { AsyncBackend::Get().Configure(options); }
+
+void LoggerManager::SetStatsReport(const std::string &logger_name, uint32_t interval_ms) {
+  {
+    std::lock_guard guard(report_mutex_);
+    report_stop_ = true;
+  }
+  report_cond_.notify_all();
+  if (report_thread_.joinable()) {
+    report_thread_.join();
+  }
+  if (interval_ms == 0) {
+    return;
+  }
+  report_stop_ = false;
+  report_thread_ = std::thread([this, logger_name, interval_ms]() {
+    std::unique_lock lock(report_mutex_);
+    while (!report_cond_.wait_for(lock, std::chrono::milliseconds(interval_ms), [this]() { return report_stop_; })) {
+      lock.unlock();
+      ReportStats(logger_name);
+      lock.lock();
+    }
+  });
+}
+
+void LoggerManager::ReportStats(const std::string &logger_name) {
+  for (const auto &logger : GetStats()) {
+    for (const auto &appender : logger.appenders) {
+      LINFO(logger_name)
+              .kv("logger", logger.name)
+              .kv("appender", appender.name)
+              .kv("events", appender.events)
+              .kv("bytes", appender.bytes)
+              .kv("drops", appender.drops)
+              .kv("queue_high_watermark", appender.queue_high_watermark)
+              .kv("blocked", appender.blocked_ns.count)
+              .kv("blocked_p99_ns", appender.blocked_ns.Percentile(0.99))
+              .kv("batch_p50", appender.batch_size.Percentile(0.5))
+              .kv("write_p50_ns", appender.write_ns.Percentile(0.5))
+              .kv("write_p99_ns", appender.write_ns.Percentile(0.99))
+          << "stats of " << logger.name << " " << appender.name << ": " << logger.events << " events";
+    }
+  }
 }
 
-LoggerManager::LoggerManager() {
+LoggerManager::LoggerManager() : loggers_(new LoggerMap()) {
   root_logger_ = std::make_shared<Logger>("root");
   ConsoleLogAppender::SharedPtr stdout_log_appender(new ConsoleLogAppender());
   root_logger_->AddAppender(stdout_log_appender);
   AddLogger(root_logger_);
+  // a manager that is never destroyed still writes out what its appenders buffer, within the
+  // default shutdown timeout for all of them; without a read section, the main thread's rcu slot
+  // may already be gone
+  std::atexit([]() {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(FileLogAppender::QueueOptions().shutdown_timeout_ms);
+    if (auto *manager = instance_) {
+      for (const auto &[name, logger] : *manager->loggers_.load(std::memory_order_acquire)) {
+        for (const auto &appender : *logger->log_appenders_.load(std::memory_order_acquire)) {
+          appender->FlushUntil(deadline);
+        }
+      }
+    }
+  });
 }
 
-LoggerManager::~LoggerManager() { loggers_.clear(); }
+LoggerManager::~LoggerManager() {
+  SetStatsReport("", 0);
+  const auto *loggers = loggers_.load(std::memory_order_relaxed);
+  // the loggers must not reach back into a manager that is going away
+  for (const auto &[name, logger] : *loggers) {
+    logger->registered_.store(false, std::memory_order_release);
+    logger->parent_.store(nullptr, std::memory_order_release);
+  }
+  delete loggers;
+}
 };  // namespace xac
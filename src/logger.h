@@ -1,6 +1,9 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstring>
 #include <ctime>
@@ -14,24 +17,67 @@
 #include <shared_mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <tuple>
+#include <utility>
 #include <vector>
+#include "arg_pack.h"
+#include "async_backend.h"
 #include "bq.h"
+#include "clock.h"
 #include "common.h"
+#include "file_writer.h"
+#include "format_program.h"
+#include "log_stream.h"
+#include "rate_limit.h"
+#include "rcu.h"
+#include "stats.h"
+#include "time_format.h"
 
-#define LLOG(logger_name, event_level)                                                                    \
-  xac::LogEventWrap::SharedPtr(                                                                           \
-      new xac::LogEventWrap(xac::LogEvent::SharedPtr(new xac::LogEvent(                                   \
-          __FILE__, time(NULL), 0, __LINE__, xac::GetThreadId(), xac::GetThreadName(), xac::GetFiberId(), \
-          LoggerManager::GetInstance()->GetLogger(logger_name)->GetName(), event_level))))                \
-      ->GetStringStream()
+// Statements below this level are compiled out, 1 (DEBUG) keeps everything.
+// e.g. `-DEASYLOG_MIN_LEVEL=3` strips DEBUG and INFO statements from the binary.
+#ifndef EASYLOG_MIN_LEVEL
+#define EASYLOG_MIN_LEVEL 1
+#endif
 
-#define LDEBUG(logger_name) LLOG(logger_name, xac::LogLevel::Level::DEBUG)
-#define LINFO(logger_name) LLOG(logger_name, xac::LogLevel::Level::INFO)
-#define LWARN(logger_name) LLOG(logger_name, xac::LogLevel::Level::WARN)
-#define LERROR(logger_name) LLOG(logger_name, xac::LogLevel::Level::ERROR)
-#define LFATAL(logger_name) LLOG(logger_name, xac::LogLevel::Level::FATAL)
+// The Logger named `logger_name`, a string literal is resolved once per call site
+// and registry generation, anything else is looked up every time.
+#define EASYLOG_LOGGER_(logger_name)                                \
+  [](const auto &easylog_name_) -> xac::Logger * {                  \
+    static xac::LoggerHandle easylog_handle_;                       \
+    return easylog_handle_.Get(easylog_name_);                      \
+  }(logger_name)
+
+// Open an `if` whose `else` branch is the log statement, so a disabled statement
+// never builds an event or evaluates its arguments. The statement's LogSite is
+// checked first, a site switched ON logs whatever the logger's level. The rest
+// is an RCU read section, which keeps the logger alive while it is used.
+#define EASYLOG_IF_ENABLED_(logger_name, event_level, format, braces)                                              \
+  if ((event_level) < EASYLOG_MIN_LEVEL) {                                                                         \
+  } else if (static xac::LogSite easylog_site_{__FILE__, __LINE__, format, __func__, event_level, braces}; false) { \
+  } else if (auto easylog_state_ = easylog_site_.GetState(); easylog_state_ == xac::LogSite::OFF) {               \
+  } else if (xac::rcu::ReadGuard easylog_guard_; false) {                                                          \
+  } else if (auto *easylog_logger_ = EASYLOG_LOGGER_(logger_name);                                                 \
+             easylog_state_ != xac::LogSite::ON && !easylog_logger_->IsEnabled(event_level)) {                     \
+  } else
+// Same for a level known at compile time, strips the statement when below EASYLOG_MIN_LEVEL
+#define EASYLOG_IF_LEVEL_(level) \
+  if constexpr (xac::LogLevel::Level::level < EASYLOG_MIN_LEVEL) { \
+  } else
+
+#define LLOG(logger_name, event_level)                                                                          \
+  EASYLOG_IF_ENABLED_(logger_name, event_level, nullptr, false)                                                     \
+  xac::LogEventWrap(easylog_logger_, xac::LogEvent::Acquire(easylog_site_, xac::Clock::Now(), xac::LogEvent::kElapseFromTime, xac::GetThreadId(),           \
+                                           xac::GetThreadName(), xac::GetFiberId(), easylog_logger_->GetName(), \
+                                           event_level))                                                        \
+      .GetStringStream()
+
+#define LDEBUG(logger_name) EASYLOG_IF_LEVEL_(DEBUG) LLOG(logger_name, xac::LogLevel::Level::DEBUG)
+#define LINFO(logger_name) EASYLOG_IF_LEVEL_(INFO) LLOG(logger_name, xac::LogLevel::Level::INFO)
+#define LWARN(logger_name) EASYLOG_IF_LEVEL_(WARN) LLOG(logger_name, xac::LogLevel::Level::WARN)
+#define LERROR(logger_name) EASYLOG_IF_LEVEL_(ERROR) LLOG(logger_name, xac::LogLevel::Level::ERROR)
+#define LFATAL(logger_name) EASYLOG_IF_LEVEL_(FATAL) LLOG(logger_name, xac::LogLevel::Level::FATAL)
 
 #define LRDEBUG LDEBUG("root")
 #define LRINFO LINFO("root")
@@ -39,30 +85,172 @@
 #define LRERROR LERROR("root")
 #define LRFATAL LFATAL("root")
 
-#define FLLOG(logger_name, event_level, format, ...)                                                      \
-  xac::LogEventWrap::SharedPtr(                                                                           \
-      new xac::LogEventWrap(xac::LogEvent::SharedPtr(new xac::LogEvent(                                   \
-          __FILE__, time(NULL), 0, __LINE__, xac::GetThreadId(), xac::GetThreadName(), xac::GetFiberId(), \
-          xac::LoggerManager::GetInstance()->GetLogger(logger_name)->GetName(), event_level))))           \
-      ->GetEvent()                                                                                        \
-      ->Format(format, __VA_ARGS__)
-#define FLDEBUG(logger_name, format, ...) FLLOG(logger_name, xac::LogLevel::Level::DEBUG, format, __VA_ARGS__)
-#define FLINFO(logger_name, format, ...) FLLOG(logger_name, xac::LogLevel::Level::INFO, format, __VA_ARGS__)
-#define FLWARN(logger_name, format, ...) FLLOG(logger_name, xac::LogLevel::Level::WARN, format, __VA_ARGS__)
-#define FLERROR(logger_name, format, ...) FLLOG(logger_name, xac::LogLevel::Level::ERROR, format, __VA_ARGS__)
-#define FLFATAL(logger_name, format, ...) FLLOG(logger_name, xac::LogLevel::Level::FATAL, format, __VA_ARGS__)
+// `format` must be a string literal, only the arguments are captured and
+// the text is printed when an appender needs it
+#define FLLOG(logger_name, event_level, format, ...)                                                            \
+  EASYLOG_IF_ENABLED_(logger_name, event_level, "" format, false)                                                   \
+  xac::LogEventWrap(easylog_logger_, xac::LogEvent::Acquire(easylog_site_, xac::Clock::Now(), xac::LogEvent::kElapseFromTime, xac::GetThreadId(),         \
+                                           xac::GetThreadName(), xac::GetFiberId(), easylog_logger_->GetName(), \
+                                           event_level))                                                        \
+      .GetEvent()                                                                                               \
+      ->Capture(__VA_ARGS__)
+#define FLDEBUG(logger_name, format, ...) \
+  EASYLOG_IF_LEVEL_(DEBUG) FLLOG(logger_name, xac::LogLevel::Level::DEBUG, format, __VA_ARGS__)
+#define FLINFO(logger_name, format, ...) \
+  EASYLOG_IF_LEVEL_(INFO) FLLOG(logger_name, xac::LogLevel::Level::INFO, format, __VA_ARGS__)
+#define FLWARN(logger_name, format, ...) \
+  EASYLOG_IF_LEVEL_(WARN) FLLOG(logger_name, xac::LogLevel::Level::WARN, format, __VA_ARGS__)
+#define FLERROR(logger_name, format, ...) \
+  EASYLOG_IF_LEVEL_(ERROR) FLLOG(logger_name, xac::LogLevel::Level::ERROR, format, __VA_ARGS__)
+#define FLFATAL(logger_name, format, ...) \
+  EASYLOG_IF_LEVEL_(FATAL) FLLOG(logger_name, xac::LogLevel::Level::FATAL, format, __VA_ARGS__)
 
 #define FLRDEBUG(format, ...) FLDEBUG("root", format, __VA_ARGS__)
 #define FLRINFO(format, ...) FLINFO("root", format, __VA_ARGS__)
-#define FLRWARN(format, ...) FLWARNING("root", fromat, __VA_ARGS__)
-#define FLRERROR(format, ...) FLERROR("root", format, _VA__ARGS__)
-#define FLRFATAL(format, ...) FLFATAL("root", format, _VA_ARGS__)
+#define FLRWARN(format, ...) FLWARN("root", format, __VA_ARGS__)
+#define FLRERROR(format, ...) FLERROR("root", format, __VA_ARGS__)
+#define FLRFATAL(format, ...) FLFATAL("root", format, __VA_ARGS__)
+
+// `format` must be a string literal with one `{}` per argument and `{{`, `}}`
+// for literal braces, anything else fails to compile. Arguments are printed
+// by type, see arg_pack::ArgFormatter for user types. Captured like FLLOG.
+#define FMTLOG(logger_name, event_level, format, ...)                                                            \
+  EASYLOG_IF_ENABLED_(logger_name, event_level, "" format, true)                                                 \
+  xac::LogEventWrap(easylog_logger_, xac::LogEvent::Acquire(easylog_site_, xac::Clock::Now(),                   \
+                                                            xac::LogEvent::kElapseFromTime, xac::GetThreadId(), \
+                                                            xac::GetThreadName(), xac::GetFiberId(),            \
+                                                            easylog_logger_->GetName(), event_level))           \
+      .GetEvent()                                                                                                \
+      ->CaptureBraces<xac::arg_pack::CountPlaceholders("" format)>(__VA_ARGS__)
+#define FMTDEBUG(logger_name, format, ...) \
+  EASYLOG_IF_LEVEL_(DEBUG) FMTLOG(logger_name, xac::LogLevel::Level::DEBUG, format, __VA_ARGS__)
+#define FMTINFO(logger_name, format, ...) \
+  EASYLOG_IF_LEVEL_(INFO) FMTLOG(logger_name, xac::LogLevel::Level::INFO, format, __VA_ARGS__)
+#define FMTWARN(logger_name, format, ...) \
+  EASYLOG_IF_LEVEL_(WARN) FMTLOG(logger_name, xac::LogLevel::Level::WARN, format, __VA_ARGS__)
+#define FMTERROR(logger_name, format, ...) \
+  EASYLOG_IF_LEVEL_(ERROR) FMTLOG(logger_name, xac::LogLevel::Level::ERROR, format, __VA_ARGS__)
+#define FMTFATAL(logger_name, format, ...) \
+  EASYLOG_IF_LEVEL_(FATAL) FMTLOG(logger_name, xac::LogLevel::Level::FATAL, format, __VA_ARGS__)
+
+#define FMTRDEBUG(format, ...) FMTDEBUG("root", format, __VA_ARGS__)
+#define FMTRINFO(format, ...) FMTINFO("root", format, __VA_ARGS__)
+#define FMTRWARN(format, ...) FMTWARN("root", format, __VA_ARGS__)
+#define FMTRERROR(format, ...) FMTERROR("root", format, __VA_ARGS__)
+#define FMTRFATAL(format, ...) FMTFATAL("root", format, __VA_ARGS__)
+
+// Rate-limited statements: the limiter is a static of the statement, checked
+// after the level and before the event is built, so a refused call costs one
+// relaxed atomic operation. A line that follows refused calls carries their
+// number as a `suppressed` field (see `%K` and `%j`).
+//   *_EVERY_N(n)                   every n-th call, starting with the first
+//   *_FIRST_N(n)                   the first n calls only
+//   *_EVERY_MS(ms)                 at most one call every `ms` milliseconds
+//   *_RATE(per_second, burst)      a token bucket, `burst` calls at once, refilled at `per_second`
+#define EASYLOG_IF_ALLOWED_(limiter, ...)                                                                   \
+  if (static xac::limiter easylog_limiter_; false) {                                                        \
+  } else if (uint64_t easylog_suppressed_ = 0; !easylog_limiter_.Allow(easylog_suppressed_, __VA_ARGS__)) { \
+  } else
+#define EASYLOG_LIMITED_EVENT_(logger_name, event_level, format, braces, limiter, ...)                          \
+  EASYLOG_IF_ENABLED_(logger_name, event_level, format, braces)                                                 \
+  EASYLOG_IF_ALLOWED_(limiter, __VA_ARGS__)                                                                     \
+  xac::LogEventWrap(easylog_logger_, xac::LogEvent::Acquire(easylog_site_, xac::Clock::Now(),                   \
+                                                            xac::LogEvent::kElapseFromTime, xac::GetThreadId(), \
+                                                            xac::GetThreadName(), xac::GetFiberId(),            \
+                                                            easylog_logger_->GetName(), event_level))
+#define EASYLOG_LLOG_LIMITED_(logger_name, event_level, limiter, ...)                    \
+  EASYLOG_LIMITED_EVENT_(logger_name, event_level, nullptr, false, limiter, __VA_ARGS__) \
+      .GetStringStream(easylog_suppressed_)
+
+#define LLOG_EVERY_N(logger_name, event_level, n) EASYLOG_LLOG_LIMITED_(logger_name, event_level, EveryN, n)
+#define LLOG_FIRST_N(logger_name, event_level, n) EASYLOG_LLOG_LIMITED_(logger_name, event_level, FirstN, n)
+#define LLOG_EVERY_MS(logger_name, event_level, ms) EASYLOG_LLOG_LIMITED_(logger_name, event_level, EveryMs, ms)
+#define LLOG_RATE(logger_name, event_level, per_second, burst) \
+  EASYLOG_LLOG_LIMITED_(logger_name, event_level, TokenBucket, per_second, burst)
+
+#define LDEBUG_EVERY_N(logger_name, n) \
+  EASYLOG_IF_LEVEL_(DEBUG) LLOG_EVERY_N(logger_name, xac::LogLevel::Level::DEBUG, n)
+#define LINFO_EVERY_N(logger_name, n) EASYLOG_IF_LEVEL_(INFO) LLOG_EVERY_N(logger_name, xac::LogLevel::Level::INFO, n)
+#define LWARN_EVERY_N(logger_name, n) EASYLOG_IF_LEVEL_(WARN) LLOG_EVERY_N(logger_name, xac::LogLevel::Level::WARN, n)
+#define LERROR_EVERY_N(logger_name, n) \
+  EASYLOG_IF_LEVEL_(ERROR) LLOG_EVERY_N(logger_name, xac::LogLevel::Level::ERROR, n)
+#define LFATAL_EVERY_N(logger_name, n) \
+  EASYLOG_IF_LEVEL_(FATAL) LLOG_EVERY_N(logger_name, xac::LogLevel::Level::FATAL, n)
+
+#define LDEBUG_FIRST_N(logger_name, n) \
+  EASYLOG_IF_LEVEL_(DEBUG) LLOG_FIRST_N(logger_name, xac::LogLevel::Level::DEBUG, n)
+#define LINFO_FIRST_N(logger_name, n) EASYLOG_IF_LEVEL_(INFO) LLOG_FIRST_N(logger_name, xac::LogLevel::Level::INFO, n)
+#define LWARN_FIRST_N(logger_name, n) EASYLOG_IF_LEVEL_(WARN) LLOG_FIRST_N(logger_name, xac::LogLevel::Level::WARN, n)
+#define LERROR_FIRST_N(logger_name, n) \
+  EASYLOG_IF_LEVEL_(ERROR) LLOG_FIRST_N(logger_name, xac::LogLevel::Level::ERROR, n)
+#define LFATAL_FIRST_N(logger_name, n) \
+  EASYLOG_IF_LEVEL_(FATAL) LLOG_FIRST_N(logger_name, xac::LogLevel::Level::FATAL, n)
+
+#define LDEBUG_EVERY_MS(logger_name, ms) \
+  EASYLOG_IF_LEVEL_(DEBUG) LLOG_EVERY_MS(logger_name, xac::LogLevel::Level::DEBUG, ms)
+#define LINFO_EVERY_MS(logger_name, ms) \
+  EASYLOG_IF_LEVEL_(INFO) LLOG_EVERY_MS(logger_name, xac::LogLevel::Level::INFO, ms)
+#define LWARN_EVERY_MS(logger_name, ms) \
+  EASYLOG_IF_LEVEL_(WARN) LLOG_EVERY_MS(logger_name, xac::LogLevel::Level::WARN, ms)
+#define LERROR_EVERY_MS(logger_name, ms) \
+  EASYLOG_IF_LEVEL_(ERROR) LLOG_EVERY_MS(logger_name, xac::LogLevel::Level::ERROR, ms)
+#define LFATAL_EVERY_MS(logger_name, ms) \
+  EASYLOG_IF_LEVEL_(FATAL) LLOG_EVERY_MS(logger_name, xac::LogLevel::Level::FATAL, ms)
+
+#define LDEBUG_RATE(logger_name, per_second, burst) \
+  EASYLOG_IF_LEVEL_(DEBUG) LLOG_RATE(logger_name, xac::LogLevel::Level::DEBUG, per_second, burst)
+#define LINFO_RATE(logger_name, per_second, burst) \
+  EASYLOG_IF_LEVEL_(INFO) LLOG_RATE(logger_name, xac::LogLevel::Level::INFO, per_second, burst)
+#define LWARN_RATE(logger_name, per_second, burst) \
+  EASYLOG_IF_LEVEL_(WARN) LLOG_RATE(logger_name, xac::LogLevel::Level::WARN, per_second, burst)
+#define LERROR_RATE(logger_name, per_second, burst) \
+  EASYLOG_IF_LEVEL_(ERROR) LLOG_RATE(logger_name, xac::LogLevel::Level::ERROR, per_second, burst)
+#define LFATAL_RATE(logger_name, per_second, burst) \
+  EASYLOG_IF_LEVEL_(FATAL) LLOG_RATE(logger_name, xac::LogLevel::Level::FATAL, per_second, burst)
+
+#define FLLOG_EVERY_N(logger_name, event_level, n, format, ...)                 \
+  EASYLOG_LIMITED_EVENT_(logger_name, event_level, "" format, false, EveryN, n) \
+      .GetEvent(easylog_suppressed_)                                            \
+      ->Capture(__VA_ARGS__)
+#define FLLOG_FIRST_N(logger_name, event_level, n, format, ...)                 \
+  EASYLOG_LIMITED_EVENT_(logger_name, event_level, "" format, false, FirstN, n) \
+      .GetEvent(easylog_suppressed_)                                            \
+      ->Capture(__VA_ARGS__)
+#define FLLOG_EVERY_MS(logger_name, event_level, ms, format, ...)                 \
+  EASYLOG_LIMITED_EVENT_(logger_name, event_level, "" format, false, EveryMs, ms) \
+      .GetEvent(easylog_suppressed_)                                              \
+      ->Capture(__VA_ARGS__)
+#define FLLOG_RATE(logger_name, event_level, per_second, burst, format, ...)                         \
+  EASYLOG_LIMITED_EVENT_(logger_name, event_level, "" format, false, TokenBucket, per_second, burst) \
+      .GetEvent(easylog_suppressed_)                                                                 \
+      ->Capture(__VA_ARGS__)
+
+#define FMTLOG_EVERY_N(logger_name, event_level, n, format, ...)               \
+  EASYLOG_LIMITED_EVENT_(logger_name, event_level, "" format, true, EveryN, n) \
+      .GetEvent(easylog_suppressed_)                                           \
+      ->CaptureBraces<xac::arg_pack::CountPlaceholders("" format)>(__VA_ARGS__)
+#define FMTLOG_FIRST_N(logger_name, event_level, n, format, ...)               \
+  EASYLOG_LIMITED_EVENT_(logger_name, event_level, "" format, true, FirstN, n) \
+      .GetEvent(easylog_suppressed_)                                           \
+      ->CaptureBraces<xac::arg_pack::CountPlaceholders("" format)>(__VA_ARGS__)
+#define FMTLOG_EVERY_MS(logger_name, event_level, ms, format, ...)               \
+  EASYLOG_LIMITED_EVENT_(logger_name, event_level, "" format, true, EveryMs, ms) \
+      .GetEvent(easylog_suppressed_)                                             \
+      ->CaptureBraces<xac::arg_pack::CountPlaceholders("" format)>(__VA_ARGS__)
+#define FMTLOG_RATE(logger_name, event_level, per_second, burst, format, ...)                       \
+  EASYLOG_LIMITED_EVENT_(logger_name, event_level, "" format, true, TokenBucket, per_second, burst) \
+      .GetEvent(easylog_suppressed_)                                                                \
+      ->CaptureBraces<xac::arg_pack::CountPlaceholders("" format)>(__VA_ARGS__)
 
 namespace xac {
 
 class Logger;
 class LogAppenderBase;
 class LoggerManager;
+class LoggerHandle;
+namespace binary_log {
+class Writer;
+}
 
 class LogLevel {
  public:
@@ -73,82 +261,338 @@ class LogLevel {
     WARN = 3,
     ERROR = 4,
     FATAL = 5,
+    OFF = 6,
   };
   static Level ToLevel(const std::string &level_str);
-  static constexpr const char *ToString(Level level);
+  static constexpr const char *ToString(Level level) {
+    switch (level) {
+#define XX(L)              \
+  case LogLevel::Level::L: \
+    return #L;
+      XX(DEBUG)
+      XX(INFO)
+      XX(WARN)
+      XX(ERROR)
+      XX(FATAL)
+      XX(OFF)
+#undef XX
+      default:
+        return "UNKNOWN";
+    }
+  }
+};
+
+// Growable output buffer for std::ostream that keeps its storage between uses
+// and exposes what was written without copying it out.
+class LineBuffer : public std::streambuf {
+ public:
+  std::string_view View() const { return {pbase(), static_cast<size_t>(pptr() - pbase())}; }
+  // drop the content, keep the storage
+  void Clear() { setp(buf_.data(), buf_.data() + buf_.size()); }
+  // room for at least `n` more bytes at the write position
+  char *Reserve(size_t n);
+  size_t Available() const { return static_cast<size_t>(epptr() - pptr()); }
+  // account for `n` bytes written into the reserved room
+  void Commit(size_t n) { pbump(static_cast<int>(n)); }
+
+ protected:
+  int_type overflow(int_type ch) override;
+
+ private:
+  std::string buf_;
+};
+
+// One per log statement, a static the macros constant-initialize, so the
+// address identifies the call site and events only point to it. Statements
+// register their site when they first run; `SetState` then switches them on
+// or off by file pattern without touching the loggers' levels.
+struct LogSite {
+  enum State {
+    UNREGISTERED = 0,  // not run yet
+    DEFAULT = 1,       // logged when the logger's level lets it through
+    ON = 2,            // logged whatever the logger's level, appender levels still apply
+    OFF = 3,           // never logged
+  };
+  const char *file_name;
+  uint32_t line;
+  const char *format;    // format of printf-style statements, nullptr for streamed ones
+  const char *function = nullptr;
+  LogLevel::Level level = LogLevel::Level::UNKNOWN;  // level of the statement's first run
+  bool braces = false;  // `format` has `{}` placeholders rather than printf conversions
+  std::atomic<State> state = UNREGISTERED;
+
+  State GetState() {
+    auto current = state.load(std::memory_order_relaxed);
+    return current != UNREGISTERED ? current : Register();
+  }
+  // every site that has run, in registration order
+  static std::vector<const LogSite *> List();
+  // Set the state of the sites matching `pattern`, a glob on the file name or
+  // its base name, optionally followed by ":line". Sites that register later
+  // pick the state up as well, DEFAULT undoes it. Returns how many registered
+  // sites matched.
+  static size_t SetState(const std::string &pattern, State state);
+
+ private:
+  State Register();
 };
 
 class LogEvent {
   friend class LogEventWrap;
+  friend struct LogEventPool;
 
  public:
-  using SharedPtr = std::shared_ptr<LogEvent>;
-  LogEvent() = delete;
-  LogEvent(const char *file_name, const uint64_t &time, const uint32_t &elapse, const uint32_t &line,
-           const uint32_t &thread_id, std::string thread_name, const uint32_t &fiber_id, std::string logger_name,
+  // pass as `elapse` to derive it from the time, see Clock::ElapseMs
+  static constexpr uint32_t kElapseFromTime = UINT32_MAX;
+
+  // `time` is a Clock stamp, nanoseconds since the epoch work as well
+  LogEvent(const LogSite &site, const uint64_t &time, const uint32_t &elapse, const uint32_t &thread_id,
+           const std::string &thread_name, const uint32_t &fiber_id, const std::string &logger_name,
            LogLevel::Level level);
-  const char *GetFileName() const { return file_name_; }
-  const uint64_t &GetTime() const { return time_; }
-  const uint32_t &GetElapse() const { return elapse_; }
-  const uint32_t &GetLine() const { return line_; }
+  LogEvent(const LogEvent &) = delete;
+  // take an event from the calling thread's free list, `Release` it on the same thread
+  static LogEvent *Acquire(const LogSite &site, const uint64_t &time, const uint32_t &elapse,
+                           const uint32_t &thread_id, const std::string &thread_name, const uint32_t &fiber_id,
+                           const std::string &logger_name, LogLevel::Level level);
+  static void Release(LogEvent *event);
+  // reuse the event for another statement
+  void Reset(const LogSite &site, const uint64_t &time, const uint32_t &elapse, const uint32_t &thread_id,
+             const std::string &thread_name, const uint32_t &fiber_id, const std::string &logger_name,
+             LogLevel::Level level);
+  const LogSite &GetSite() const { return *site_; }
+  const char *GetFileName() const { return site_->file_name; }
+  const char *GetFunction() const { return site_->function; }
+  // nanoseconds since the epoch
+  uint64_t GetTime() const { return Clock::ToNs(time_); }
+  // milliseconds since program start
+  uint32_t GetElapse() const { return elapse_ == kElapseFromTime ? Clock::ElapseMs(GetTime()) : elapse_; }
+  // the unconverted values, for handing the event to another thread
+  const uint64_t &GetStamp() const { return time_; }
+  const uint32_t &GetRawElapse() const { return elapse_; }
+  const uint32_t &GetLine() const { return site_->line; }
   const uint32_t &GetThreadId() const { return thread_id_; }
-  const std::string &GetThreadName() const { return thread_name_; }
+  const std::string &GetThreadName() const { return *thread_name_; }
   const uint32_t &GetFiberId() const { return fiber_id_; }
-  const std::string GetContent() const { return content_ss_.str(); }
+  // the message, printed from the captured arguments on first use
+  std::string_view GetContent() const;
   LogLevel::Level GetLevel() const { return level_; }
-  const std::string GetLoggerName() { return logger_name_; }
-  std::stringstream &GetStringStream() { return content_ss_; }
-  void Format(const char *format, ...);
+  const std::string &GetLoggerName() const { return *logger_name_; }
+  LogStream &GetStringStream() { return content_; }
+  // fields attached with LogStream::kv, key and value pairs encoded by arg_pack
+  std::string_view GetFields() const { return content_.Fields(); }
+  void SetFields(std::string_view packed) { content_.SetFields(packed); }
+  // capture printf-style arguments for the site's format
+  template <typename... Args>
+  void Capture(const Args &...args) {
+    Format(site_->format, args...);
+  }
+  // capture arguments for the site's `{}` format, which has `kPlaceholders` of them
+  template <int kPlaceholders, typename... Args>
+  void CaptureBraces(const Args &...args) {
+    static_assert(kPlaceholders >= 0, "unmatched brace in format, write {{ and }} for literal braces");
+    static_assert(kPlaceholders == sizeof...(Args), "number of {} in format and number of arguments differ");
+    Format(site_->format, args...);
+    braces_ = true;
+  }
+  // capture printf-style arguments, `format` must outlive the event
+  template <typename... Args>
+  void Format(const char *format, const Args &...args) {
+    format_ = format;
+    braces_ = false;
+    formatted_ = false;
+    args_buf_.Clear();
+    (arg_pack::Encode(args_buf_, args), ...);
+  }
+  // take arguments that were captured elsewhere
+  void SetArgs(const char *format, std::string_view packed, bool braces = false);
+  // format and captured arguments, format is nullptr for streamed content
+  const char *GetFormat() const { return format_; }
+  // whether the format has `{}` placeholders rather than printf conversions
+  bool HasBraces() const { return braces_; }
+  std::string_view GetArgs() const { return args_buf_.View(); }
 
  private:
-  const char *file_name_;         // file name
-  uint64_t time_;                 // timestamp
-  uint32_t elapse_;               // elapsed time from program run
-  uint32_t line_;                 // line number
-  uint32_t thread_id_;            // thread id
-  std::string thread_name_;       // thread name
-  uint32_t fiber_id_;             // fiber id
-  std::stringstream content_ss_;  // content
-  std::string logger_name_;
+  const LogSite *site_;             // file name, line number and format
+  uint64_t time_;                   // Clock stamp
+  uint32_t elapse_;                 // milliseconds from program run, or kElapseFromTime
+  uint32_t thread_id_;              // thread id
+  const std::string *thread_name_;  // thread name, owned by the thread
+  uint32_t fiber_id_;               // fiber id
+  mutable LogStream content_;       // streamed content, or the printed arguments
+  const char *format_ = nullptr;    // printf-style format of the captured arguments
+  LineBuffer args_buf_;             // arguments encoded by arg_pack
+  mutable bool formatted_ = false;  // content_ holds the printed arguments
+  bool braces_ = false;             // format_ has `{}` placeholders
+  const std::string *logger_name_;        // interned by the logger
   LogLevel::Level level_;
+  LogEvent *next_free_ = nullptr;  // free list link while pooled
 };
 
+// Logs the event when the statement ends and gives it back to the pool
 class LogEventWrap {
  public:
-  typedef std::shared_ptr<LogEventWrap> SharedPtr;
-  LogEventWrap(LogEvent::SharedPtr event) : event_(event) {}
+  LogEventWrap(Logger *logger, LogEvent *event) : logger_(logger), event_(event) {}
+  LogEventWrap(const LogEventWrap &) = delete;
   ~LogEventWrap();
-  LogEvent::SharedPtr GetEvent() { return event_; }
-  std::stringstream &GetStringStream() { return event_->GetStringStream(); }
+  LogEvent *GetEvent() { return event_; }
+  LogStream &GetStringStream() { return event_->GetStringStream(); }
+  // same, with a `suppressed` field when a rate-limited statement refused calls before this one
+  LogEvent *GetEvent(uint64_t suppressed) {
+    GetStringStream(suppressed);
+    return event_;
+  }
+  LogStream &GetStringStream(uint64_t suppressed) {
+    if (suppressed > 0) {
+      event_->GetStringStream().kv("suppressed", suppressed);
+    }
+    return event_->GetStringStream();
+  }
 
  private:
-  LogEvent::SharedPtr event_;
+  Logger *logger_;
+  LogEvent *event_;
 };
 
+// The built-in patterns, usable as StaticFormatter parameters
+inline constexpr char kComplexPattern[] = "[%p]%d{%Y-%m-%d %H:%M:%S}%T(tid)%t%T[%c]%T%f:%l%T%m%n";
+inline constexpr char kSimplePattern[] = "[%p]%T[%c]%T%f:%l%T%m%n";
+inline constexpr char kJsonPattern[] = "%j%n";
+
 class Formatter {
  public:
   using SharedPtr = std::shared_ptr<Formatter>;
   Formatter() { PatternParse(); }
   explicit Formatter(std::string pattern);
-  // output the event as formatted
-  void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event);
+  // the program points into pattern_
+  Formatter(const Formatter &) = delete;
+  // output the event as formatted, through the format items
+  void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event);
+  // append the event as formatted to `out`, through the compiled program
+  void Format(LineBuffer &out, LogLevel::Level level, const LogEvent &event);
+  // run one instruction of a compiled pattern
+  static void Execute(const format_program::Instruction &ins, LineBuffer &out, LogLevel::Level level,
+                      const LogEvent &event);
+  // same, with the instruction known at compile time
+  template <format_program::Op kOp>
+  static void Execute(std::string_view arg, LineBuffer &out, LogLevel::Level level, const LogEvent &event);
   class FormatItemBase {  // every format item has `Format` method to output
                           // their content
    public:
     using SharedPtr = std::shared_ptr<FormatItemBase>;
     // FormatItemBase(const std::string& str = "") {}
     virtual ~FormatItemBase() = default;
-    virtual void Format(std::ostream &os, LogLevel::Level level, const LogEvent::SharedPtr &event) = 0;
+    virtual void Format(std::ostream &os, LogLevel::Level level, const LogEvent &event) = 0;
   };
   static const std::string COMPLEXPATTERN;
   static const std::string SIMPLEPATTERN;
+  static const std::string JSONPATTERN;  // one JSON object per line
+  // append the event as a JSON object, fields at the top level next to the fixed ones
+  static void FormatJson(std::string_view time_format, LineBuffer &out, LogLevel::Level level,
+                         const LogEvent &event);
+  // append the fields as ` key=value`
+  static void FormatFields(LineBuffer &out, const LogEvent &event);
 
  private:
-  std::string pattern_ = std::string(SIMPLEPATTERN);     // the pattern of formatter
+  std::string pattern_ = kSimplePattern;                 // the pattern of formatter
   std::vector<FormatItemBase::SharedPtr> format_items_;  // formatted items
+  std::vector<format_program::Instruction> program_;     // the same pattern as instructions
   void PatternParse();                                   // parse the pattern to format items
 };
 
+template <format_program::Op kOp>
+inline void Formatter::Execute(std::string_view arg, LineBuffer &out, LogLevel::Level level, const LogEvent &event) {
+  auto put = [&out](std::string_view str) {
+    memcpy(out.Reserve(str.size()), str.data(), str.size());
+    out.Commit(str.size());
+  };
+  auto put_number = [&out](uint64_t value) {
+    auto *dst = out.Reserve(20);
+    out.Commit(std::to_chars(dst, dst + 20, value).ptr - dst);
+  };
+  if constexpr (kOp == format_program::Op::LITERAL) {
+    put(arg);
+  } else if constexpr (kOp == format_program::Op::CONTENT) {
+    put(event.GetContent());
+  } else if constexpr (kOp == format_program::Op::LEVEL) {
+    put(LogLevel::ToString(level));
+  } else if constexpr (kOp == format_program::Op::ELAPSE) {
+    put_number(event.GetElapse());
+  } else if constexpr (kOp == format_program::Op::LOGGER_NAME) {
+    put(event.GetLoggerName());
+  } else if constexpr (kOp == format_program::Op::THREAD_ID) {
+    put_number(event.GetThreadId());
+  } else if constexpr (kOp == format_program::Op::NEW_LINE) {
+    put("\n");
+  } else if constexpr (kOp == format_program::Op::TIME) {
+    auto *dst = out.Reserve(128);
+    out.Commit(FormatTime(arg.empty() ? kDefaultTimeFormat : arg, event.GetTime(), dst, 128));
+  } else if constexpr (kOp == format_program::Op::FILE_NAME) {
+    put(event.GetFileName());
+  } else if constexpr (kOp == format_program::Op::LINE) {
+    put_number(event.GetLine());
+  } else if constexpr (kOp == format_program::Op::TAB) {
+    put("  ");
+  } else if constexpr (kOp == format_program::Op::FIBER_ID) {
+    put_number(event.GetFiberId());
+  } else if constexpr (kOp == format_program::Op::THREAD_NAME) {
+    put(event.GetThreadName());
+  } else if constexpr (kOp == format_program::Op::JSON) {
+    FormatJson(arg, out, level, event);
+  } else if constexpr (kOp == format_program::Op::FIELDS) {
+    FormatFields(out, event);
+  } else {
+    put("<<error_format %");
+    put(arg);
+    put(">>");
+  }
+}
+
+inline void Formatter::Execute(const format_program::Instruction &ins, LineBuffer &out, LogLevel::Level level,
+                               const LogEvent &event) {
+  switch (ins.op) {
+#define XX(OP)                                                   \
+  case format_program::Op::OP:                                   \
+    Execute<format_program::Op::OP>(ins.arg, out, level, event); \
+    break;
+    XX(LITERAL)
+    XX(CONTENT)
+    XX(LEVEL)
+    XX(ELAPSE)
+    XX(LOGGER_NAME)
+    XX(THREAD_ID)
+    XX(NEW_LINE)
+    XX(TIME)
+    XX(FILE_NAME)
+    XX(LINE)
+    XX(TAB)
+    XX(FIBER_ID)
+    XX(THREAD_NAME)
+    XX(JSON)
+    XX(FIELDS)
+    XX(ERROR)
+#undef XX
+  }
+}
+
+// Formatter for a pattern known at compile time, the program is built by the
+// compiler and every instruction is expanded inline.
+// e.g. `StaticFormatter<kSimplePattern>::Format(out, level, event)`
+template <const char *Pattern>
+class StaticFormatter {
+ public:
+  static void Format(LineBuffer &out, LogLevel::Level level, const LogEvent &event) {
+    Run(out, level, event, std::make_index_sequence<kSize>());
+  }
+
+ private:
+  static constexpr size_t kSize = format_program::Count(Pattern);
+  static constexpr format_program::Program<kSize> kProgram = format_program::Compile<kSize>(Pattern);
+  template <size_t... I>
+  static void Run(LineBuffer &out, LogLevel::Level level, const LogEvent &event, std::index_sequence<I...>) {
+    (Formatter::Execute<kProgram.code[I].op>(kProgram.code[I].arg, out, level, event), ...);
+  }
+};
+
 class LogAppenderBase {
   friend class Logger;
 
@@ -163,63 +607,249 @@ class LogAppenderBase {
   void SetLevel(LogLevel::Level level);
   // get the level of the appender
   LogLevel::Level GetLevel();
+  // what the appender has written, dropped and waited for so far
+  AppenderStats GetStats();
+  // names the appender in its stats
+  virtual std::string GetName() const { return "appender"; }
+  // events dropped by the overflow policy so far
+  virtual uint64_t GetDropped() const { return 0; }
+  // wait until every event logged to the appender before the call is written
+  virtual void Flush() {}
+  // same, giving up at the deadline; false if it did. The default has no deadline
+  virtual bool FlushUntil(std::chrono::steady_clock::time_point) {
+    Flush();
+    return true;
+  }
+  // from a crash handler: write what is buffered or queued with raw write(2),
+  // without locks or allocation
+  virtual void CrashFlush() {}
 
  protected:
   LogAppenderBase();
   std::shared_mutex shared_mutex_;
-  LogLevel::Level level_ = LogLevel::Level::DEBUG;
+  std::atomic<LogLevel::Level> level_ = LogLevel::Level::DEBUG;
+  std::vector<Logger *> owners_;  // loggers holding this appender, told when the level changes
   Formatter::SharedPtr formatter_;
+  AppenderMetrics metrics_;
   // set the event level and log it
-  virtual void Log(LogLevel::Level level, LogEvent::SharedPtr event) = 0;
+  virtual void Log(LogLevel::Level level, const LogEvent &event) = 0;
 };
 
+// Loggers registered with the LoggerManager form a tree by their dotted names:
+// the parent of "svc.db.pool" is "svc.db" if there is one, else "svc", else
+// the root logger. A logger without a level of its own takes its parent's,
+// and an additive logger also logs to its parent's appenders.
 class Logger {
  public:
   using SharedPtr = std::shared_ptr<Logger>;
   Logger() = delete;
-  Logger(const std::string &name);
+  // loggers built here start non-additive, the ones the LoggerManager creates for a name are additive
+  Logger(const std::string &name, bool additive = false);
   Logger(const Logger &logger) = delete;
   ~Logger();
   // log the event
-  void Log(const LogEvent::SharedPtr &event);
+  void Log(const LogEvent &event);
   void AddAppender(const LogAppenderBase::SharedPtr &appender);
   // get log appender by name
   LogAppenderBase::SharedPtr GetAppender(const std::string &appender_name);
   // delete a log appender to the logger
   void DeleteAppender(const std::string &appender_name);
+  // remove one appender
+  void DeleteAppender(const LogAppenderBase::SharedPtr &appender);
   // clear all log appenders
-  void ClearAppenders() { log_appenders_.clear(); }
-  const std::string &GetName() { return name_; }
+  void ClearAppenders();
+  const std::string &GetName() { return *name_; }
+  // events below `level` are dropped, UNKNOWN inherits the parent's level
+  void SetLevel(LogLevel::Level level);
+  // the level in effect, own or inherited
+  LogLevel::Level GetLevel() const { return threshold_.load(std::memory_order_relaxed); }
+  // whether events also go to the parent's appenders
+  void SetAdditivity(bool additive);
+  bool GetAdditivity() const { return additive_.load(std::memory_order_relaxed); }
+  // nullptr for the root and for loggers that are not registered
+  Logger *GetParent() const { return parent_.load(std::memory_order_acquire); }
+  // whether an event of `level` would reach at least one appender
+  bool IsEnabled(LogLevel::Level level) const { return level >= level_.load(std::memory_order_relaxed); }
+  // events logged so far, with the stats of each appender
+  LoggerStats GetStats() const;
 
  private:
-  std::string name_;
-  std::shared_mutex shared_mutex_;
-  // the list of logappenders
-  std::list<LogAppenderBase::SharedPtr> log_appenders_;
+  friend class LogAppenderBase;
+  friend class LoggerManager;
+  using AppenderList = std::vector<LogAppenderBase::SharedPtr>;
+  // recompute the effective levels after a configuration change, of the whole tree if registered
+  void UpdateLevel();
+  // recompute this logger's levels from its parent's, which must be up to date
+  void ComputeLevel();
+  // swap in a changed copy of the appender list and free the old one once no `Log` uses it
+  void Publish(std::unique_ptr<AppenderList> appenders);
+  const std::string *name_;  // interned, stays valid after the logger is gone
+  std::atomic<LogLevel::Level> own_level_ = LogLevel::Level::UNKNOWN;  // set by SetLevel
+  std::atomic<LogLevel::Level> threshold_ = LogLevel::Level::UNKNOWN;  // own or inherited level
+  std::atomic<LogLevel::Level> reach_ = LogLevel::Level::OFF;          // lowest level any appender takes
+  std::atomic<LogLevel::Level> level_ = LogLevel::Level::OFF;          // lowest level that gets logged
+  std::atomic<bool> additive_;
+  std::atomic<Logger *> parent_ = nullptr;  // maintained by the LoggerManager
+  std::atomic<bool> registered_ = false;
+  bool implicit_ = false;   // created by the LoggerManager for a name, AddLogger may replace it
+  std::mutex mutex_;  // serializes changes to the appender list
+  // the list of logappenders, immutable once published, read under rcu::ReadGuard
+  std::atomic<const AppenderList *> log_appenders_;
+  ShardedCounter events_;
 };
 
-class ConsoleLogAppender : public LogAppenderBase {
+// Writes every line, color codes included, to stdout with a single write(2),
+// so lines from different threads never interleave. Lines are colored by level
+// when stdout is a terminal. An async appender hands the lines to the
+// AsyncBackend, whose workers write them, one write per batch, so callers do
+// not block on a slow stdout.
+class ConsoleLogAppender : public LogAppenderBase, public AsyncSink {
  public:
-  ConsoleLogAppender() = default;
+  explicit ConsoleLogAppender(bool async = false);
+  ~ConsoleLogAppender() override;
+  // color lines by level, the default is whether stdout is a terminal
+  void SetColored(bool colored) { colored_.store(colored, std::memory_order_relaxed); }
+  std::string GetName() const override { return "console"; }
+  void Flush() override;
+  bool FlushUntil(std::chrono::steady_clock::time_point deadline) override;
+  void CrashFlush() override;
+  void Consume(const char *data, size_t len) override;
+  void EndBatch() override;
+  void CrashConsume(const char *data, size_t len) override;
 
  private:
-  void Log(LogLevel::Level level, LogEvent::SharedPtr event) override;
+  void Log(LogLevel::Level level, const LogEvent &event) override;
+  // write out batch_, batch_mutex_ held
+  void WriteBatch();
+  const bool async_;
+  std::atomic<bool> colored_;
+  std::mutex batch_mutex_;  // records pushed while the pool is reconfigured may reach two workers
+  std::string batch_;       // lines consumed in the current backend batch
+  uint64_t batch_events_ = 0;
 };
 
-class FileLogAppender : public LogAppenderBase {
+struct DeferredRecord;
+class AppenderTimer;
+
+class FileLogAppender : public LogAppenderBase, public AsyncSink {
  public:
+  enum AsyncMode {
+    SYNC = 0,         // write on the caller's thread
+    RING_BUFFER = 1,  // per-thread lock-free rings drained by the shared AsyncBackend workers
+    BLOCK_DEQUE = 2,  // one BlockDeque and one writer thread per appender
+    DEFERRED = 3,     // like RING_BUFFER, but only the raw event is queued and the backend formats it
+    BINARY = 4,       // like DEFERRED, but the backend writes the binary format read by easylog-decode
+  };
+  enum FsyncPolicy {
+    NO_FSYNC = 0,        // leave it to the kernel
+    FSYNC_ON_FLUSH = 1,  // fsync after every flush
+    FSYNC_ON_LEVEL = 2,  // fsync after flushes caused by an event at or above `flush_level`
+  };
+  // When the SYNC mode writes its buffer to the file, whichever comes first.
+  // The delay is kept by a timer as well, so a logger that goes quiet still
+  // gets its lines written. The async modes write once per backend batch instead.
+  struct FlushPolicy {
+    size_t max_bytes = FileWriter::kDefaultCapacity;       // buffered bytes
+    uint32_t max_delay_ms = 1000;                          // age of the oldest buffered line
+    LogLevel::Level flush_level = LogLevel::Level::ERROR;  // an event at or above this level
+    FsyncPolicy fsync = FsyncPolicy::NO_FSYNC;
+  };
+  // What an async appender does with an event that does not fit its queue
+  enum OverflowPolicy {
+    BLOCK = 0,          // wait for room
+    BLOCK_TIMEOUT = 1,  // wait up to `block_timeout_ms`, then drop the event
+    DROP_NEWEST = 2,    // drop the event
+    DROP_OLDEST = 3,    // queue it anyway, the writer drops the oldest queued events beyond the capacity
+    KEEP_WARN = 4,      // drop events below WARN, wait for room for the rest
+  };
+  struct QueueOptions {
+    size_t capacity_bytes = 0;  // queued and unwritten bytes, 0 for no limit beyond the queue's own size
+    OverflowPolicy policy = OverflowPolicy::BLOCK;
+    uint32_t block_timeout_ms = 10;
+    uint32_t shutdown_timeout_ms = 5000;  // the destructor drops the lines or records still queued after this
+  };
   FileLogAppender(const std::string &file_name);
+  // `is_async` selects RING_BUFFER
   FileLogAppender(std::string file_name, const bool is_async);
+  FileLogAppender(std::string file_name, AsyncMode mode);
+  // `queue_options` apply to the async modes
+  FileLogAppender(std::string file_name, AsyncMode mode, const QueueOptions &queue_options);
   ~FileLogAppender();
+  void SetFlushPolicy(const FlushPolicy &policy);
+  // DEFERRED and BINARY: an event with the same call site, logger, level and content as the last one
+  // written, within `window_ms` of it, is not written; a "last message repeated N times" line follows
+  // the run, when a different event arrives, on Flush or once the window is over. 0, the default,
+  // writes every event. False, and nothing changes, in the other modes, which queue formatted lines.
+  bool SetDedupWindow(uint32_t window_ms);
+  std::string GetName() const override { return file_name_; }
+  uint64_t GetDropped() const override { return dropped_.load(std::memory_order_relaxed); }
+  // write everything logged before the call to the file, and fsync it unless the policy is NO_FSYNC
+  void Flush() override;
+  bool FlushUntil(std::chrono::steady_clock::time_point deadline) override;
+  void CrashFlush() override;
+  // continue in a new file of the same name, e.g. after the old one was rotated away
+  bool Reopen();
 
  private:
-  bool is_async_ = false;
+  AsyncMode mode_ = AsyncMode::SYNC;
   std::thread async_log_writter_;
   std::unique_ptr<BlockDeque<std::string>> log_string_buf_;
+  std::atomic<uint64_t> block_deque_pushed_ = 0;
+  std::atomic<uint64_t> block_deque_done_ = 0;  // of the pushed lines, written or dropped
+  std::atomic<bool> abandon_queue_ = false;     // the destructor timed out, what is still queued is dropped
   const std::string file_name_;
-  bool ReopenFile();
-  std::ofstream file_stream_;
-  void Log(LogLevel::Level level, LogEvent::SharedPtr event) override;
+  std::mutex file_mutex_;  // every writer of file_: callers, the BLOCK_DEQUE thread, the backend workers
+  FileWriter file_;
+  FlushPolicy flush_policy_;
+  uint64_t first_buffered_time_ = 0;  // time of the oldest buffered event
+  uint64_t buffered_events_ = 0;      // events in the buffer, or consumed in the current backend batch
+  uint64_t batch_bytes_ = 0;          // bytes consumed in the current backend batch
+  const QueueOptions queue_options_;
+  std::atomic<int64_t> queued_bytes_ = 0;  // only counted with a capacity, briefly negative when the writer is quick
+  std::atomic<uint64_t> dropped_ = 0;
+  std::atomic<uint64_t> unreported_drops_ = 0;  // not yet announced in the file
+  // the run of repeated events, see SetDedupWindow; guarded by file_mutex_
+  struct Repeats {
+    uint64_t hash = 0;
+    uint64_t until_ns = 0;  // end of the window opened by the event that was written
+    uint64_t count = 0;     // events suppressed since
+    uint64_t stamp = 0;     // of the last suppressed one
+    const LogSite *site = nullptr;
+    const std::string *logger_name = nullptr;
+    LogLevel::Level level = LogLevel::Level::DEBUG;
+    uint32_t thread_id = 0;
+    uint32_t fiber_id = 0;
+    std::string thread_name;
+  };
+  std::atomic<uint32_t> dedup_window_ms_ = 0;
+  Repeats repeats_;
+  void Log(LogLevel::Level level, const LogEvent &event) override;
+  void Consume(const char *data, size_t len) override;
+  void EndBatch() override;
+  void CrashConsume(const char *data, size_t len) override;
+  // whether a `len` byte record fits the capacity
+  bool HasRoom(size_t len) const;
+  // retry `ready()` as long as the overflow policy lets an event of `level` wait, false if it gives up
+  template <typename Ready>
+  bool WaitFor(LogLevel::Level level, Ready &&ready);
+  // writer side: account for a written record, false if DROP_OLDEST wants it dropped instead
+  bool Dequeue(size_t len);
+  void Dropped();
+  // writer side: the "N messages dropped" line once the queue is back under its capacity
+  void ReportDrops();
+  // backend side, file_mutex_ held: whether the record hashed to `hash` repeats the run and is
+  // suppressed; otherwise the run ends and the record starts the next one
+  bool Repeated(uint64_t hash, const DeferredRecord &record, std::string_view thread_name);
+  // file_mutex_ held: write the "repeated N times" line of the run, if any, and end it
+  void EndRepeats();
+  friend class AppenderTimer;
+  // called by the AppenderTimer: write out what is due
+  void OnTimer();
+  // file_mutex_ held: buffer an event the appender logs itself
+  void WriteOwnEvent(const LogEvent &event);
+  // write the buffered events to the file, and fsync it if `sync`
+  void WriteOut(bool sync);
+  std::unique_ptr<binary_log::Writer> binary_writer_;
 };
 
 class LoggerManager : public Singleton<LoggerManager> {
@@ -231,12 +861,76 @@ class LoggerManager : public Singleton<LoggerManager> {
   bool DeleteLogger(const std::shared_ptr<Logger> &logger);
   bool DeleteLogger(const std::string &logger_name);
   void ClearLoggers();
-  const std::shared_ptr<Logger> &GetLogger(const std::string &logger_name);
+  // the logger named `logger_name`, created as an additive logger if there is none
+  std::shared_ptr<Logger> GetLogger(const std::string &logger_name);
+  // same without taking a reference, only valid inside an rcu::ReadGuard
+  Logger *FindLogger(std::string_view logger_name);
+  // set the level of `logger_name` and with it of every descendant without its own level
+  void SetLevel(const std::string &logger_name, LogLevel::Level level);
+  // wait until every event logged before the call is written by every appender of a registered logger
+  void Flush();
+  // async-signal-safe: write the lines the appenders still buffer or queue with raw write(2),
+  // for a crash handler of your own; lines queued as raw events for DEFERRED and BINARY are lost
+  static void CrashFlush();
+  // opt in: on SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT run CrashFlush, then die by the signal
+  static void InstallCrashHandler();
+  // the stats of every registered logger
+  std::vector<LoggerStats> GetStats();
+  // every `interval_ms` log the stats of each appender as an INFO event to `logger_name`, 0 stops
+  void SetStatsReport(const std::string &logger_name, uint32_t interval_ms);
+  // set the number of AsyncBackend workers and their CPUs, see AsyncBackend::Options
+  void SetBackendOptions(const AsyncBackend::Options &options);
+  // bumped whenever the set of loggers changes
+  uint64_t GetGeneration() const { return generation_.load(std::memory_order_acquire); }
 
  private:
-  std::shared_ptr<Logger> root_logger_;
-  std::map<std::string, std::shared_ptr<Logger>> loggers_;
+  friend class LoggerHandle;
+  friend class Logger;
+  using LoggerMap = std::map<std::string, std::shared_ptr<Logger>, std::less<>>;
   LoggerManager();
+  // Swap in a changed copy of the registry and relink the tree. mutex_ must be
+  // held; readers may take it, so the old copy is only retired and callers
+  // outside a read section call rcu::Synchronize once they have let go of it.
+  void Publish(std::unique_ptr<LoggerMap> loggers);
+  // the logger named `logger_name`, created if missing; mutex_ must be held
+  const std::shared_ptr<Logger> &FindOrCreate(std::string_view logger_name);
+  // point the loggers of `next` at their nearest registered ancestor, detach the ones only in `prev`
+  void Relink(const LoggerMap &prev, const LoggerMap &next);
+  // recompute every logger's levels, parents first; mutex_ must be held
+  void UpdateLevels();
+  // look up `logger_name` and store the result in `handle`
+  Logger *Resolve(std::string_view logger_name, LoggerHandle &handle);
+  std::shared_ptr<Logger> root_logger_;
+  std::mutex mutex_;  // serializes registry changes and handle updates
+  std::atomic<const LoggerMap *> loggers_;  // immutable once published, read under rcu::ReadGuard
+  std::atomic<uint64_t> generation_ = 1;
+  // the periodic stats report
+  void ReportStats(const std::string &logger_name);
+  std::mutex report_mutex_;
+  std::condition_variable report_cond_;
+  bool report_stop_ = false;
+  std::thread report_thread_;
+};
+
+// A call site's cached Logger, see EASYLOG_LOGGER_. Valid while the registry
+// generation is unchanged; callers must be inside an rcu::ReadGuard.
+class LoggerHandle {
+ public:
+  template <size_t N>
+  Logger *Get(const char (&logger_name)[N]) {
+    auto *manager = LoggerManager::GetInstance();
+    // the logger stored with a generation is at least as new as it
+    if (generation_.load(std::memory_order_acquire) == manager->GetGeneration()) {
+      return logger_.load(std::memory_order_relaxed);
+    }
+    return manager->Resolve(std::string_view(logger_name, strnlen(logger_name, N)), *this);
+  }
+  Logger *Get(std::string_view logger_name) { return LoggerManager::GetInstance()->FindLogger(logger_name); }
+
+ private:
+  friend class LoggerManager;
+  std::atomic<uint64_t> generation_ = 0;
+  std::atomic<Logger *> logger_ = nullptr;
 };
 
 }  // end namespace xac
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace xac {
+
+// Per call site limiters for the *_EVERY_N, *_FIRST_N, *_EVERY_MS and *_RATE
+// statements. Each is a static of its statement, checked with relaxed atomics
+// before the event is built. `Allow` sets `suppressed` to the calls refused
+// since the last allowed one.
+
+// every n-th call, starting with the first
+class EveryN {
+ public:
+  bool Allow(uint64_t &suppressed, uint64_t n) {
+    auto count = count_.fetch_add(1, std::memory_order_relaxed);
+    if (n > 1 && count % n != 0) {
+      return false;
+    }
+    suppressed = count == 0 || n <= 1 ? 0 : n - 1;
+    return true;
+  }
+
+ private:
+  std::atomic<uint64_t> count_ = 0;
+};
+
+// the first n calls, nothing after them
+class FirstN {
+ public:
+  bool Allow(uint64_t &suppressed, uint64_t n) {
+    // a plain load once the budget is spent, so a hot site does not bounce the line
+    if (count_.load(std::memory_order_relaxed) >= n) {
+      return false;
+    }
+    suppressed = 0;
+    return count_.fetch_add(1, std::memory_order_relaxed) < n;
+  }
+
+ private:
+  std::atomic<uint64_t> count_ = 0;
+};
+
+// at most one call every `interval_ms`
+class EveryMs {
+ public:
+  bool Allow(uint64_t &suppressed, uint64_t interval_ms) {
+    auto now = Now();
+    auto next = next_ns_.load(std::memory_order_relaxed);
+    if (now < next || !next_ns_.compare_exchange_strong(next, now + interval_ms * 1000000, std::memory_order_relaxed)) {
+      suppressed_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+    return true;
+  }
+
+ private:
+  static uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+  std::atomic<uint64_t> next_ns_ = 0;
+  std::atomic<uint64_t> suppressed_ = 0;
+};
+
+// A token bucket refilled at `per_second` tokens and holding up to `burst`,
+// kept as the time the bucket would be full again (GCRA), so one CAS updates it.
+class TokenBucket {
+ public:
+  bool Allow(uint64_t &suppressed, double per_second, uint64_t burst) {
+    if (per_second > 0 && burst > 0) {
+      auto interval = static_cast<uint64_t>(1e9 / per_second);
+      auto now = Now();
+      auto full_at = full_at_.load(std::memory_order_relaxed);
+      while (true) {
+        auto next = std::max(full_at, now) + interval;
+        if (next - now > burst * interval) {
+          break;
+        }
+        if (full_at_.compare_exchange_weak(full_at, next, std::memory_order_relaxed)) {
+          suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+          return true;
+        }
+      }
+    }
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+ private:
+  static uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+  std::atomic<uint64_t> full_at_ = 0;
+  std::atomic<uint64_t> suppressed_ = 0;
+};
+
+}  // end namespace xac
@@ -0,0 +1,113 @@
+#include "rcu.h"
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xac {
+namespace rcu {
+
+// per thread: the epoch its current read section started in, 0 outside of one
+struct alignas(64) ReaderSlot {
+  std::atomic<uint64_t> epoch{0};
+  uint32_t depth = 0;  // owner thread only
+};
+
+namespace {
+
+// With membarrier(2) the writer forces the barrier onto the readers' CPUs, so
+// readers only need to keep the compiler from reordering.
+bool asymmetric_fence = false;
+
+struct Registry {
+  std::atomic<uint64_t> epoch{1};
+  std::mutex mutex;  // guards slots, serializes writers
+  std::vector<std::shared_ptr<ReaderSlot>> slots;
+  std::mutex retired_mutex;  // separate, readers may retire while a writer waits for them
+  std::vector<std::function<void()>> retired;
+  Registry() {
+    asymmetric_fence = syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+  }
+};
+
+Registry &GetRegistry() {
+  static auto *registry = new Registry();  // readers may still run during static destruction
+  return *registry;
+}
+
+struct SlotHandle {
+  std::shared_ptr<ReaderSlot> slot;
+  SlotHandle() : slot(std::make_shared<ReaderSlot>()) {
+    auto &registry = GetRegistry();
+    std::lock_guard guard(registry.mutex);
+    registry.slots.push_back(slot);
+  }
+  ~SlotHandle() {
+    auto &registry = GetRegistry();
+    std::lock_guard guard(registry.mutex);
+    registry.slots.erase(std::remove(registry.slots.begin(), registry.slots.end(), slot), registry.slots.end());
+  }
+};
+
+ReaderSlot &LocalSlot() {
+  thread_local SlotHandle handle;
+  return *handle.slot;
+}
+
+}  // namespace
+
+ReadGuard::ReadGuard() : slot_(&LocalSlot()) {
+  if (slot_->depth++ == 0) {
+    slot_->epoch.store(GetRegistry().epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // the epoch must be visible before the reader loads any protected pointer
+    if (asymmetric_fence) {
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    } else {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+  }
+}
+
+ReadGuard::~ReadGuard() {
+  if (--slot_->depth == 0) {
+    slot_->epoch.store(0, std::memory_order_release);
+  }
+}
+
+void Synchronize() {
+  auto &registry = GetRegistry();
+  std::vector<std::function<void()>> retired;
+  {
+    std::lock_guard guard(registry.retired_mutex);
+    retired.swap(registry.retired);
+  }
+  std::unique_lock lock(registry.mutex);
+  // readers entering from now on see the new epoch and, thanks to the fences, the new data
+  auto target = registry.epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+  if (asymmetric_fence) {
+    syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+  }
+  for (const auto &slot : registry.slots) {
+    uint64_t epoch;
+    while ((epoch = slot->epoch.load(std::memory_order_acquire)) != 0 && epoch < target) {
+      std::this_thread::yield();
+    }
+  }
+  lock.unlock();
+  for (auto &reclaim : retired) {
+    reclaim();
+  }
+}
+
+void Retire(std::function<void()> reclaim) {
+  auto &registry = GetRegistry();
+  std::lock_guard guard(registry.retired_mutex);
+  registry.retired.push_back(std::move(reclaim));
+}
+
+}  // namespace rcu
+}  // end namespace xac
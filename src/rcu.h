@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+namespace xac {
+
+// Read-copy-update for data read on every event and changed rarely. Readers
+// only touch a slot owned by their thread; a writer publishes a new copy with
+// an atomic store, calls `Synchronize` and then frees the old copy, which no
+// reader can still be looking at.
+namespace rcu {
+
+struct ReaderSlot;
+
+// Marks the calling thread as reading for its lifetime, may be nested.
+class ReadGuard {
+ public:
+  ReadGuard();
+  ReadGuard(const ReadGuard &) = delete;
+  ~ReadGuard();
+
+ private:
+  ReaderSlot *slot_;
+};
+
+// Wait until every read section that started before this call has ended.
+// Must not be called from inside a read section.
+void Synchronize();
+
+// Run `reclaim` after the next `Synchronize` has waited for the readers, for
+// writers that cannot wait themselves, e.g. because they are inside a read
+// section or hold a lock a reader may take. Safe inside a read section.
+void Retire(std::function<void()> reclaim);
+
+}  // namespace rcu
+
+}  // end namespace xac
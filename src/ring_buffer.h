@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace xac {
+
+// Single-producer single-consumer byte ring holding variable-length records.
+// Positions are monotonic counters, the slot is `pos & mask_`. Every record
+// starts with an 8-byte header; a record that would straddle the end of the
+// buffer is preceded by a padding record that fills the tail.
+class SpscRingBuffer {
+ public:
+  static constexpr size_t kHeaderSize = 8;
+
+  explicit SpscRingBuffer(size_t capacity) {
+    capacity_ = kHeaderSize * 2;
+    while (capacity_ < capacity) {
+      capacity_ <<= 1;
+    }
+    mask_ = capacity_ - 1;
+    buf_ = std::make_unique<char[]>(capacity_);
+  }
+  SpscRingBuffer(const SpscRingBuffer &) = delete;
+  SpscRingBuffer &operator=(const SpscRingBuffer &) = delete;
+
+  size_t Capacity() const { return capacity_; }
+  // largest payload a single record can carry
+  size_t MaxRecordSize() const { return capacity_ / 2 - kHeaderSize; }
+
+  // producer: get room for `size` bytes, nullptr if the ring is full
+  char *Reserve(size_t size) {
+    size_t total = Align(kHeaderSize + size);
+    size_t offset = write_pos_local_ & mask_;
+    size_t tail = capacity_ - offset;
+    size_t needed = total > tail ? total + tail : total;
+    if (capacity_ - (write_pos_local_ - read_pos_cached_) < needed) {
+      read_pos_cached_ = read_pos_.load(std::memory_order_acquire);
+      if (capacity_ - (write_pos_local_ - read_pos_cached_) < needed) {
+        return nullptr;
+      }
+    }
+    if (total > tail) {
+      WriteHeader(offset, static_cast<uint32_t>(tail), kPadding);
+      write_pos_local_ += tail;
+      offset = 0;
+    }
+    reserved_ = total;
+    return buf_.get() + offset + kHeaderSize;
+  }
+
+  // producer: publish the record returned by the last `Reserve`
+  void Commit(size_t size) {
+    WriteHeader(write_pos_local_ & mask_, static_cast<uint32_t>(size), 0);
+    write_pos_local_ += reserved_;
+    write_pos_.store(write_pos_local_, std::memory_order_release);
+  }
+
+  // consumer: the oldest record, nullptr if the ring is empty
+  const char *Front(size_t &size) {
+    while (true) {
+      if (read_pos_local_ == write_pos_cached_) {
+        write_pos_cached_ = write_pos_.load(std::memory_order_acquire);
+        if (read_pos_local_ == write_pos_cached_) {
+          return nullptr;
+        }
+      }
+      uint32_t len;
+      uint32_t flags;
+      ReadHeader(read_pos_local_ & mask_, len, flags);
+      if (flags & kPadding) {
+        read_pos_local_ += len;
+        continue;
+      }
+      size = len;
+      return buf_.get() + (read_pos_local_ & mask_) + kHeaderSize;
+    }
+  }
+
+  // consumer: release the record returned by the last `Front`
+  void Pop() {
+    uint32_t len;
+    uint32_t flags;
+    ReadHeader(read_pos_local_ & mask_, len, flags);
+    read_pos_local_ += Align(kHeaderSize + len);
+    read_pos_.store(read_pos_local_, std::memory_order_release);
+  }
+
+  // any thread, e.g. a crash handler: visit the records not consumed yet
+  // without consuming them; a consumer running meanwhile may be at one of them
+  template <typename F>
+  void Peek(F &&visit) const {
+    for (size_t pos = ReadPosition(), end = WritePosition(); pos < end;) {
+      uint32_t len;
+      uint32_t flags;
+      ReadHeader(pos & mask_, len, flags);
+      if ((flags & kPadding) == 0) {
+        visit(buf_.get() + (pos & mask_) + kHeaderSize, static_cast<size_t>(len));
+        pos += Align(kHeaderSize + len);
+      } else {
+        pos += len;
+      }
+    }
+  }
+
+  // any thread: bytes written / consumed so far
+  size_t WritePosition() const { return write_pos_.load(std::memory_order_acquire); }
+  size_t ReadPosition() const { return read_pos_.load(std::memory_order_acquire); }
+  bool Empty() const { return ReadPosition() == WritePosition(); }
+
+ private:
+  static constexpr uint32_t kPadding = 1;
+  static size_t Align(size_t n) { return (n + kHeaderSize - 1) & ~(kHeaderSize - 1); }
+  void WriteHeader(size_t offset, uint32_t len, uint32_t flags) {
+    memcpy(buf_.get() + offset, &len, sizeof(len));
+    memcpy(buf_.get() + offset + sizeof(len), &flags, sizeof(flags));
+  }
+  void ReadHeader(size_t offset, uint32_t &len, uint32_t &flags) const {
+    memcpy(&len, buf_.get() + offset, sizeof(len));
+    memcpy(&flags, buf_.get() + offset + sizeof(len), sizeof(flags));
+  }
+
+  std::unique_ptr<char[]> buf_;
+  size_t capacity_;
+  size_t mask_;
+  // producer side
+  alignas(64) std::atomic<size_t> write_pos_{0};
+  size_t write_pos_local_ = 0;
+  size_t read_pos_cached_ = 0;
+  size_t reserved_ = 0;
+  // consumer side
+  alignas(64) std::atomic<size_t> read_pos_{0};
+  size_t read_pos_local_ = 0;
+  size_t write_pos_cached_ = 0;
+};
+
+}  // end namespace xac
@@ -0,0 +1,46 @@
+#include "stats.h"
+
+namespace xac {
+
+auto Histogram::Percentile(double p) const -> uint64_t {
+  if (count == 0) {
+    return 0;
+  }
+  auto rank = static_cast<uint64_t>(p * static_cast<double>(count - 1)) + 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; i++) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      // the top bucket is open ended, the largest value bounds it
+      return i == 0 ? 0 : std::min(max, i == kBuckets - 1 ? max : (uint64_t(1) << i) - 1);
+    }
+  }
+  return max;
+}
+
+auto AtomicHistogram::Load() const -> Histogram {
+  Histogram histogram;
+  for (int i = 0; i < Histogram::kBuckets; i++) {
+    histogram.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    histogram.count += histogram.buckets[i];
+  }
+  histogram.sum = sum_.load(std::memory_order_relaxed);
+  histogram.max = max_.load(std::memory_order_relaxed);
+  return histogram;
+}
+
+auto ShardedCounter::Load() const -> uint64_t {
+  uint64_t total = 0;
+  for (const auto &shard : shards_) {
+    total += shard.value.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+auto ShardedCounter::ShardIndex() -> size_t {
+  static std::atomic<size_t> next = 0;
+  thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+  return index;
+}
+
+}  // end namespace xac
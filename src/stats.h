@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace xac {
+
+// Counts of values in power-of-two buckets: bucket 0 holds 0, bucket i holds
+// [2^(i-1), 2^i). A snapshot, see `AtomicHistogram` for the recording side.
+struct Histogram {
+  static constexpr int kBuckets = 40;
+  uint64_t buckets[kBuckets] = {};
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t max = 0;
+  static int Bucket(uint64_t value) { return value == 0 ? 0 : std::min(kBuckets - 1, 64 - __builtin_clzll(value)); }
+  // upper bound of the bucket holding the `p` quantile, 0 when empty
+  uint64_t Percentile(double p) const;
+  uint64_t Mean() const { return count == 0 ? 0 : sum / count; }
+};
+
+// Recorded with relaxed atomics; written on slow paths only (a producer that
+// had to wait, a backend batch), so the buckets are shared.
+class AtomicHistogram {
+ public:
+  void Record(uint64_t value) {
+    buckets_[Histogram::Bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    auto max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+  }
+  Histogram Load() const;
+
+ private:
+  std::atomic<uint64_t> buckets_[Histogram::kBuckets] = {};
+  std::atomic<uint64_t> sum_ = 0;
+  std::atomic<uint64_t> max_ = 0;
+};
+
+// A counter for hot paths: each thread adds to one of a few cache-line sized
+// shards, picked once per thread, and readers sum the shards.
+class ShardedCounter {
+ public:
+  static constexpr size_t kShards = 16;
+  void Add(uint64_t n) { shards_[ShardIndex()].value.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t Load() const;
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> value{0};
+  };
+  static size_t ShardIndex();
+  Shard shards_[kShards];
+};
+
+// What an appender has done so far, see `LogAppenderBase::GetStats`.
+struct AppenderStats {
+  std::string name;
+  uint64_t events = 0;  // written
+  uint64_t bytes = 0;   // written
+  uint64_t drops = 0;   // dropped by the overflow policy
+  uint64_t queue_high_watermark = 0;  // the most bytes the writer found queued at once, async modes only
+  Histogram blocked_ns;  // time producers waited for room in the queue, one value per wait
+  Histogram batch_size;  // events per write to the file or the console
+  Histogram write_ns;    // time of each of those writes
+};
+
+// See `Logger::GetStats`; bytes and drops are summed over the appenders.
+struct LoggerStats {
+  std::string name;
+  uint64_t events = 0;  // that passed the logger's level
+  uint64_t bytes = 0;
+  uint64_t drops = 0;
+  std::vector<AppenderStats> appenders;
+};
+
+// The recording side of AppenderStats, kept by each appender.
+struct AppenderMetrics {
+  ShardedCounter events;
+  ShardedCounter bytes;
+  std::atomic<uint64_t> queue_high_watermark = 0;
+  AtomicHistogram blocked_ns;
+  AtomicHistogram batch_size;
+  AtomicHistogram write_ns;
+  void Written(uint64_t bytes_written) {
+    events.Add(1);
+    bytes.Add(bytes_written);
+  }
+  void Queued(uint64_t queued_bytes) {
+    auto max = queue_high_watermark.load(std::memory_order_relaxed);
+    while (queued_bytes > max &&
+           !queue_high_watermark.compare_exchange_weak(max, queued_bytes, std::memory_order_relaxed)) {
+    }
+  }
+  // the time since `start` in ns
+  static uint64_t Since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+};
+
+}  // end namespace xac
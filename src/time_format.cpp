@@ -0,0 +1,158 @@
+#include "time_format.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+namespace xac {
+
+namespace {
+
+constexpr size_t kMaxFormat = 64;
+constexpr size_t kMaxText = 128;
+constexpr size_t kMaxSlots = 4;
+
+// `format` printed for one second, with blanks where the sub-second digits go
+struct TimeCacheEntry {
+  char format[kMaxFormat];
+  size_t format_len = 0;
+  int64_t second = -1;
+  char text[kMaxText];
+  size_t text_len = 0;
+  struct Slot {
+    uint8_t offset;
+    uint8_t digits;
+  } slots[kMaxSlots];
+  size_t slot_count = 0;
+};
+
+// strftime one piece of the format that holds no sub-second specifier
+void Strftime(TimeCacheEntry &entry, std::string_view piece, const struct tm &tm_struct) {
+  if (piece.empty()) {
+    return;
+  }
+  char piece_format[kMaxFormat];
+  memcpy(piece_format, piece.data(), piece.size());
+  piece_format[piece.size()] = '\0';
+  entry.text_len += strftime(entry.text + entry.text_len, kMaxText - entry.text_len, piece_format, &tm_struct);
+}
+
+void Build(TimeCacheEntry &entry, std::string_view format, int64_t second) {
+  memcpy(entry.format, format.data(), format.size());
+  entry.format_len = format.size();
+  entry.second = second;
+  entry.text_len = 0;
+  entry.slot_count = 0;
+  struct tm tm_struct;
+  auto time = static_cast<time_t>(second);
+  localtime_r(&time, &tm_struct);
+  size_t piece = 0;
+  for (size_t i = 0; i + 1 < format.size(); i++) {
+    if (format[i] != '%') {
+      continue;
+    }
+    auto spec = format[i + 1];
+    uint8_t digits = spec == 'L' ? 3 : spec == 'f' ? 6 : spec == 'N' ? 9 : 0;
+    if (digits == 0 || entry.slot_count == kMaxSlots) {
+      // %% and the strftime specifiers stay in the piece
+      ++i;
+      continue;
+    }
+    Strftime(entry, format.substr(piece, i - piece), tm_struct);
+    if (entry.text_len + digits > kMaxText) {
+      break;
+    }
+    entry.slots[entry.slot_count++] = {static_cast<uint8_t>(entry.text_len), digits};
+    entry.text_len += digits;
+    piece = i + 2;
+    ++i;
+  }
+  Strftime(entry, format.substr(piece), tm_struct);
+}
+
+// a format too long for the cache, printed straight into `dst`
+size_t FormatLong(std::string_view format, int64_t second, uint32_t sub_second, char *dst, size_t cap) {
+  struct tm tm_struct;
+  auto time = static_cast<time_t>(second);
+  localtime_r(&time, &tm_struct);
+  size_t len = 0;
+  auto put = [&](const char *data, size_t size) {
+    size = std::min(size, cap - len);
+    memcpy(dst + len, data, size);
+    len += size;
+  };
+  auto strftime_piece = [&](std::string_view piece) {
+    if (piece.empty()) {
+      return;
+    }
+    std::string piece_format(piece);
+    std::string text(kMaxText, '\0');
+    size_t text_len;
+    // strftime returns 0 when the text does not fit, or when the piece prints nothing
+    while ((text_len = strftime(text.data(), text.size(), piece_format.c_str(), &tm_struct)) == 0 &&
+           text.size() < piece.size() * 32) {
+      text.resize(text.size() * 2);
+    }
+    put(text.data(), text_len);
+  };
+  size_t piece = 0;
+  for (size_t i = 0; i + 1 < format.size(); i++) {
+    if (format[i] != '%') {
+      continue;
+    }
+    auto spec = format[i + 1];
+    size_t digits = spec == 'L' ? 3 : spec == 'f' ? 6 : spec == 'N' ? 9 : 0;
+    ++i;
+    if (digits == 0) {
+      continue;
+    }
+    strftime_piece(format.substr(piece, i - 1 - piece));
+    char text[9];
+    auto value = sub_second;
+    for (size_t d = digits; d < 9; d++) {
+      value /= 10;
+    }
+    for (size_t d = digits; d-- > 0;) {
+      text[d] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    }
+    put(text, digits);
+    piece = i + 1;
+  }
+  strftime_piece(format.substr(piece));
+  return len;
+}
+
+}  // namespace
+
+size_t FormatTime(std::string_view format, uint64_t time_ns, char *dst, size_t cap) {
+  thread_local TimeCacheEntry cache[4];
+  auto second = static_cast<int64_t>(time_ns / 1000000000);
+  auto sub_second = static_cast<uint32_t>(time_ns % 1000000000);
+  if (format.size() >= kMaxFormat) {
+    return FormatLong(format, second, sub_second, dst, cap);
+  }
+  // the format usually lives in a pattern, so its address is a good hash
+  auto *entry = &cache[(reinterpret_cast<uintptr_t>(format.data()) >> 4) & 3];
+  if (entry->second != second || std::string_view(entry->format, entry->format_len) != format) {
+    Build(*entry, format, second);
+  }
+  auto len = std::min(entry->text_len, cap);
+  memcpy(dst, entry->text, len);
+  for (size_t i = 0; i < entry->slot_count; i++) {
+    const auto &slot = entry->slots[i];
+    auto value = sub_second;
+    for (int d = slot.digits; d < 9; d++) {
+      value /= 10;
+    }
+    for (size_t d = slot.digits; d-- > 0;) {
+      if (slot.offset + d < len) {
+        dst[slot.offset + d] = static_cast<char>('0' + value % 10);
+      }
+      value /= 10;
+    }
+  }
+  return len;
+}
+
+}  // end namespace xac
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace xac {
+
+constexpr std::string_view kDefaultTimeFormat = "%Y-%m-%d %H:%M:%S";
+// ISO 8601 with milliseconds and the UTC offset, the default of %j
+constexpr std::string_view kJsonTimeFormat = "%Y-%m-%dT%H:%M:%S.%L%z";
+
+// Print `time_ns` (nanoseconds since the epoch, local time) with a strftime
+// format extended by sub-second specifiers: %L milliseconds, %f microseconds
+// and %N nanoseconds, zero padded. The strftime part is cached per thread and
+// format for the current second, so most events only patch in the digits.
+// Formats of 64 characters or more are printed without the cache.
+// Writes at most `cap` bytes to `dst` and returns how many were written.
+size_t FormatTime(std::string_view format, uint64_t time_ns, char *dst, size_t cap);
+
+}  // end namespace xac
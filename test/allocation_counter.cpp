@@ -0,0 +1,16 @@
+// counting allocator, lets allocation_test see every operator new made by the calling thread;
+// in its own file so these are never inlined next to a mismatched allocation function
+#include <cstdlib>
+#include <new>
+
+thread_local size_t allocation_count = 0;
+
+void *operator new(size_t size) {
+  ++allocation_count;
+  if (void *ptr = malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
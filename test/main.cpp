@@ -1,7 +1,16 @@
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
 #include <thread>
+#include "binary_log.h"
 #include "logger.h"
 using namespace xac;
 
+// counted by the replacement operator new in allocation_counter.cpp
+extern thread_local size_t allocation_count;
+
 void filelog_test() {
   auto logger = std::make_shared<Logger>("test");
 
@@ -36,6 +45,488 @@ void filelog_test() {
   t.join();
 }
 
+// the SYNC mode only writes to the file when its flush policy says so
+void flush_policy_test() {
+  auto logger = std::make_shared<Logger>("flush");
+  auto appender = std::make_shared<FileLogAppender>("flush.log");
+  FileLogAppender::FlushPolicy policy;
+  policy.max_delay_ms = 60000;
+  appender->SetFlushPolicy(policy);
+  logger->AddAppender(appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  auto file_size = []() {
+    std::ifstream file("flush.log", std::ios_base::ate);
+    return static_cast<long>(file.tellg());
+  };
+  LINFO("flush") << "buffered";
+  auto after_info = file_size();
+  LERROR("flush") << "flushed at once";
+  auto after_error = file_size();
+  LINFO("flush") << "buffered again";
+  appender->Flush();
+  auto after_flush = file_size();
+  LoggerManager::GetInstance()->DeleteLogger("flush");
+  std::cout << "file size after INFO " << after_info << ", after ERROR " << after_error << ", after Flush "
+            << after_flush << std::endl;
+
+  // a logger that goes quiet still gets its lines written after the delay
+  logger = std::make_shared<Logger>("flush.quiet");
+  appender = std::make_shared<FileLogAppender>("flush_quiet.log");
+  policy.max_delay_ms = 20;
+  appender->SetFlushPolicy(policy);
+  logger->AddAppender(appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  LINFO("flush.quiet") << "written by the timer";
+  std::ifstream quiet_file("flush_quiet.log", std::ios_base::ate);
+  auto before_delay = static_cast<long>(quiet_file.tellg());
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  quiet_file.close();
+  quiet_file.open("flush_quiet.log", std::ios_base::ate);
+  std::cout << "quiet logger written: " << (before_delay == 0) << " " << (quiet_file.tellg() > 0) << " (expect 1 1)"
+            << std::endl;
+  LoggerManager::GetInstance()->DeleteLogger("flush.quiet");
+}
+
+// log the same load through both async transports so they can be compared
+void filelog_mode_test() {
+  auto run = [](const std::string &name, FileLogAppender::AsyncMode mode) {
+    auto logger = std::make_shared<Logger>(name);
+    auto appender = std::make_shared<FileLogAppender>(name + ".log", mode);
+    logger->AddAppender(appender);
+    LoggerManager::GetInstance()->AddLogger(logger);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+      threads.emplace_back([&name]() {
+        auto i = 10000;
+        while (i--) {
+          LINFO(name) << i;
+        }
+      });
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+    appender->Flush();
+    auto cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LoggerManager::GetInstance()->DeleteLogger(name);
+    std::ifstream file(name + ".log", std::ios_base::ate);
+    auto mb = static_cast<double>(file.tellg()) / (1 << 20);
+    std::cout << name << ": " << static_cast<int>(cost * 1000) << "ms, " << static_cast<int>(mb / cost) << " MB/s"
+              << std::endl;
+  };
+  run("sync", FileLogAppender::AsyncMode::SYNC);
+  run("ring_buffer", FileLogAppender::AsyncMode::RING_BUFFER);
+  run("block_deque", FileLogAppender::AsyncMode::BLOCK_DEQUE);
+}
+
+// a small queue with each overflow policy: written lines plus dropped events add up, and the drops are announced
+void overflow_test() {
+  const char *names[] = {"BLOCK", "BLOCK_TIMEOUT", "DROP_NEWEST", "DROP_OLDEST", "KEEP_WARN"};
+  for (auto policy : {FileLogAppender::BLOCK, FileLogAppender::BLOCK_TIMEOUT, FileLogAppender::DROP_NEWEST,
+                      FileLogAppender::DROP_OLDEST, FileLogAppender::KEEP_WARN}) {
+    for (auto mode : {FileLogAppender::AsyncMode::RING_BUFFER, FileLogAppender::AsyncMode::BLOCK_DEQUE}) {
+      FileLogAppender::QueueOptions options;
+      options.capacity_bytes = 4096;
+      options.policy = policy;
+      options.block_timeout_ms = 0;
+      auto logger = std::make_shared<Logger>("overflow");
+      auto appender = std::make_shared<FileLogAppender>("overflow.log", mode, options);
+      logger->AddAppender(appender);
+      LoggerManager::GetInstance()->AddLogger(logger);
+      constexpr int kEvents = 20000;
+      for (int i = 0; i < kEvents; i++) {
+        if (i % 10 == 0) {
+          LWARN("overflow") << "event " << i;
+        } else {
+          LINFO("overflow") << "event " << i;
+        }
+      }
+      appender->Flush();
+      std::ifstream file("overflow.log");
+      std::string line;
+      int written = 0;
+      int reports = 0;
+      while (std::getline(file, line)) {
+        bool report = line.find("messages dropped") != std::string::npos;
+        reports += report;
+        written += !report;
+      }
+      LoggerManager::GetInstance()->DeleteLogger("overflow");
+      std::cout << names[policy] << (mode == FileLogAppender::AsyncMode::BLOCK_DEQUE ? " (block_deque)" : "")
+                << ": written " << written << " + dropped " << appender->GetDropped() << " = "
+                << written + appender->GetDropped() << " of " << kEvents << ", announced " << (reports > 0)
+                << std::endl;
+    }
+  }
+}
+
+// a record too large for the ring is dropped and counted, never cut
+void oversize_test() {
+  std::string big(AsyncBackend::kDefaultQueueCapacity, 'x');
+  for (auto mode : {FileLogAppender::AsyncMode::RING_BUFFER, FileLogAppender::AsyncMode::DEFERRED,
+                    FileLogAppender::AsyncMode::BINARY}) {
+    auto logger = std::make_shared<Logger>("oversize");
+    auto appender = std::make_shared<FileLogAppender>("oversize.log", mode);
+    logger->AddAppender(appender);
+    LoggerManager::GetInstance()->AddLogger(logger);
+    LINFO("oversize") << big;
+    FLINFO("oversize", "%s", big.c_str());
+    LINFO("oversize") << "small";
+    appender->Flush();
+    std::ifstream file("oversize.log", std::ios_base::ate);
+    std::cout << "oversize mode " << mode << ": dropped " << appender->GetDropped() << ", file smaller than the record "
+              << (static_cast<size_t>(file.tellg()) < big.size()) << " (expect dropped 2, 1)" << std::endl;
+    LoggerManager::GetInstance()->DeleteLogger("oversize");
+  }
+}
+
+// the stats count what reaches the files, and the report logs them as fields
+void stats_test() {
+  auto logger = std::make_shared<Logger>("stats");
+  auto sync_appender = std::make_shared<FileLogAppender>("stats_sync.log");
+  auto async_appender = std::make_shared<FileLogAppender>("stats_async.log", FileLogAppender::AsyncMode::RING_BUFFER);
+  logger->AddAppender(sync_appender);
+  logger->AddAppender(async_appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  for (int i = 0; i < 1000; i++) {
+    LINFO("stats") << "event " << i;
+  }
+  sync_appender->Flush();
+  async_appender->Flush();
+  auto file_size = [](const char *name) {
+    std::ifstream file(name, std::ios_base::ate | std::ios_base::binary);
+    return static_cast<uint64_t>(file.tellg());
+  };
+  auto stats = logger->GetStats();
+  std::cout << "stats events: " << stats.events << " " << stats.appenders[0].events << " "
+            << stats.appenders[1].events << ", bytes match files: "
+            << (stats.appenders[0].bytes == file_size("stats_sync.log")) << " "
+            << (stats.appenders[1].bytes == file_size("stats_async.log"))
+            << " (expect stats events: 1000 1000 1000, bytes match files: 1 1)" << std::endl;
+  std::cout << "stats batches: " << (stats.appenders[1].batch_size.sum == 1000) << " "
+            << (stats.appenders[1].queue_high_watermark > 0) << " (expect 1 1)" << std::endl;
+
+  auto report_logger = std::make_shared<Logger>("stats.report");
+  auto report_appender = std::make_shared<FileLogAppender>("stats_report.log");
+  report_appender->SetFormatter(std::make_shared<Formatter>("%m%K%n"));
+  report_logger->AddAppender(report_appender);
+  LoggerManager::GetInstance()->AddLogger(report_logger);
+  LoggerManager::GetInstance()->SetStatsReport("stats.report", 10);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  LoggerManager::GetInstance()->SetStatsReport("", 0);
+  report_appender->Flush();
+  std::ifstream report_file("stats_report.log");
+  std::string line;
+  bool reported = false;
+  while (std::getline(report_file, line)) {
+    reported |= line.find("stats of stats stats_sync.log: 1000 events") == 0 &&
+                line.find(" events=1000 ") != std::string::npos;
+  }
+  std::cout << "stats reported: " << reported << " (expect 1)" << std::endl;
+  LoggerManager::GetInstance()->DeleteLogger("stats");
+  LoggerManager::GetInstance()->DeleteLogger("stats.report");
+}
+
+// rate-limited statements log a few of many calls and count the rest
+void rate_limit_test() {
+  auto logger = std::make_shared<Logger>("limit");
+  auto appender = std::make_shared<FileLogAppender>("limit.log");
+  appender->SetFormatter(std::make_shared<Formatter>("%m%K%n"));
+  logger->AddAppender(appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  for (int i = 0; i < 3500; i++) {
+    LINFO_EVERY_N("limit", 1000) << "every_n " << i;
+    LWARN_FIRST_N("limit", 3) << "first_n " << i;
+    LERROR_EVERY_MS("limit", 60000) << "every_ms " << i;
+    LINFO_RATE("limit", 1, 5) << "rate " << i;
+    FMTLOG_EVERY_N("limit", LogLevel::Level::INFO, 2000, "braces {}", i);
+  }
+  appender->Flush();
+  std::ifstream file("limit.log");
+  std::stringstream lines;
+  lines << file.rdbuf();
+  std::cout << lines.str();
+  std::cout << "(expect every_n 0, every_n 1000 suppressed=999, every_n 2000 suppressed=999, every_n 3000 "
+               "suppressed=999, first_n 0 1 2, every_ms 0, rate 0 to 4, braces 0, braces 2000 suppressed=1999)"
+            << std::endl;
+  LoggerManager::GetInstance()->DeleteLogger("limit");
+}
+
+// repeated events collapse into one line and a count, different ones do not
+void dedup_test() {
+  auto logger = std::make_shared<Logger>("dedup");
+  auto appender = std::make_shared<FileLogAppender>("dedup.log", FileLogAppender::AsyncMode::DEFERRED);
+  appender->SetFormatter(std::make_shared<Formatter>("%p %m%n"));
+  appender->SetDedupWindow(60000);
+  logger->AddAppender(appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  auto fail = [](int n) {
+    for (int i = 0; i < n; i++) {
+      LERROR("dedup") << "connect failed";
+    }
+  };
+  fail(1000);
+  for (int i = 0; i < 4; i++) {
+    FMTWARN("dedup", "retry {}", i % 2);
+  }
+  fail(5);
+  appender->Flush();
+  std::ifstream file("dedup.log");
+  std::stringstream lines;
+  lines << file.rdbuf();
+  std::cout << lines.str();
+  std::cout << "(expect ERROR connect failed, ERROR last message repeated 999 times, WARN retry 0, WARN retry 1, "
+               "WARN retry 0, WARN retry 1, ERROR connect failed, ERROR last message repeated 4 times)"
+            << std::endl;
+  LoggerManager::GetInstance()->DeleteLogger("dedup");
+
+  // once the window is over the count is written without another event, and the other modes refuse
+  logger = std::make_shared<Logger>("dedup.idle");
+  appender = std::make_shared<FileLogAppender>("dedup_idle.log", FileLogAppender::AsyncMode::DEFERRED);
+  appender->SetFormatter(std::make_shared<Formatter>("%m%n"));
+  bool set = appender->SetDedupWindow(20);
+  logger->AddAppender(appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  for (int i = 0; i < 10; i++) {
+    LERROR("dedup.idle") << "timeout";
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  std::ifstream idle_file("dedup_idle.log");
+  std::stringstream idle_lines;
+  idle_lines << idle_file.rdbuf();
+  FileLogAppender ring_appender("dedup_ring.log", FileLogAppender::AsyncMode::RING_BUFFER);
+  std::cout << "dedup set " << set << ", refused " << !ring_appender.SetDedupWindow(20) << ", idle run written "
+            << (idle_lines.str() == "timeout\nlast message repeated 9 times\n") << " (expect 1, 1, 1)" << std::endl;
+  LoggerManager::GetInstance()->DeleteLogger("dedup.idle");
+}
+
+// with several backend workers every event still arrives, and a file gets them in time order;
+// the producers take turns, so the events are pushed in the order of their stamps
+void backend_pool_test() {
+  AsyncBackend::Options options;
+  options.workers = 4;
+  options.cpus = {0};
+  LoggerManager::GetInstance()->SetBackendOptions(options);
+  auto logger = std::make_shared<Logger>("pool");
+  auto formatter = std::make_shared<Formatter>("%d{%s%N} %m%n");
+  auto ring_appender = std::make_shared<FileLogAppender>("pool_ring.log", FileLogAppender::AsyncMode::RING_BUFFER);
+  auto deferred_appender = std::make_shared<FileLogAppender>("pool_deferred.log", FileLogAppender::AsyncMode::DEFERRED);
+  ring_appender->SetFormatter(formatter);
+  deferred_appender->SetFormatter(formatter);
+  logger->AddAppender(ring_appender);
+  logger->AddAppender(deferred_appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  constexpr int kThreads = 8;
+  constexpr int kEvents = 5000;
+  std::mutex turn;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([t, &turn]() {
+      for (int i = 0; i < kEvents; i++) {
+        std::lock_guard guard(turn);
+        FMTINFO("pool", "{} {}", t, i);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  LoggerManager::GetInstance()->Flush();
+  for (const char *name : {"pool_ring.log", "pool_deferred.log"}) {
+    std::ifstream file(name);
+    std::vector<int> next(kThreads, 0);
+    int lines = 0;
+    bool ordered = true;
+    bool in_time_order = true;
+    uint64_t last_time = 0;
+    uint64_t time;
+    int t;
+    int i;
+    while (file >> time >> t >> i) {
+      lines++;
+      ordered &= t >= 0 && t < kThreads && next[t]++ == i;
+      in_time_order &= time >= last_time;
+      last_time = time;
+    }
+    std::cout << name << ": " << lines << " lines, in order per thread " << ordered << ", in time order "
+              << in_time_order << " (expect " << kThreads * kEvents << " lines, 1, 1)" << std::endl;
+  }
+  LoggerManager::GetInstance()->DeleteLogger("pool");
+  LoggerManager::GetInstance()->SetBackendOptions(AsyncBackend::Options());
+}
+
+// nothing queued is lost: not by a flush barrier, an appender's destruction or a crash
+void shutdown_test() {
+  auto count_lines = [](const char *name) {
+    std::ifstream file(name);
+    std::string line;
+    int lines = 0;
+    while (std::getline(file, line)) {
+      lines++;
+    }
+    return lines;
+  };
+  auto logger = std::make_shared<Logger>("shutdown");
+  auto deque_appender = std::make_shared<FileLogAppender>("shutdown_deque.log", FileLogAppender::AsyncMode::BLOCK_DEQUE);
+  auto ring_appender = std::make_shared<FileLogAppender>("shutdown_ring.log", FileLogAppender::AsyncMode::RING_BUFFER);
+  logger->AddAppender(deque_appender);
+  logger->AddAppender(ring_appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  for (int i = 0; i < 10000; i++) {
+    LINFO("shutdown") << "line " << i;
+  }
+  LoggerManager::GetInstance()->Flush();
+  std::cout << "after the flush barrier: " << count_lines("shutdown_deque.log") << " "
+            << count_lines("shutdown_ring.log") << " (expect 10000 10000)" << std::endl;
+  for (int i = 0; i < 10000; i++) {
+    LINFO("shutdown") << "line " << i;
+  }
+  LoggerManager::GetInstance()->DeleteLogger("shutdown");
+  logger.reset();
+  deque_appender.reset();
+  ring_appender.reset();
+  std::cout << "after destruction: " << count_lines("shutdown_deque.log") << " " << count_lines("shutdown_ring.log")
+            << " (expect 20000 20000)" << std::endl;
+
+  // a sink that holds the backend up: a flush with a deadline gives up, and an appender
+  // whose shutdown timeout passes drops its records instead of writing them
+  struct SlowSink : AsyncSink {
+    void Consume(const char *, size_t) override { std::this_thread::sleep_for(std::chrono::milliseconds(300)); }
+  } slow_sink;
+  FileLogAppender::QueueOptions queue_options;
+  queue_options.shutdown_timeout_ms = 20;
+  logger = std::make_shared<Logger>("shutdown.slow");
+  ring_appender = std::make_shared<FileLogAppender>("shutdown_slow.log", FileLogAppender::AsyncMode::RING_BUFFER,
+                                                    queue_options);
+  logger->AddAppender(ring_appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  AsyncBackend::Get().Push(&slow_sink, 0, "x", 1);
+  for (int i = 0; i < 100; i++) {
+    LINFO("shutdown.slow") << "line " << i;
+  }
+  bool flushed = AsyncBackend::Get().Flush(std::chrono::steady_clock::now() + std::chrono::milliseconds(20));
+  LoggerManager::GetInstance()->DeleteLogger("shutdown.slow");
+  logger.reset();
+  ring_appender.reset();
+  std::ifstream slow_file("shutdown_slow.log");
+  std::string slow_text((std::istreambuf_iterator<char>(slow_file)), std::istreambuf_iterator<char>());
+  std::cout << "slow backend: flushed in time " << flushed << ", only the drops reported "
+            << (count_lines("shutdown_slow.log") == 1 && slow_text.find("100 messages dropped") != std::string::npos)
+            << " (expect 0, 1)" << std::endl;
+
+  // the child has no backend thread, only the crash handler writes its ring records
+  logger = std::make_shared<Logger>("crash");
+  auto sync_appender = std::make_shared<FileLogAppender>("crash_sync.log");
+  FileLogAppender::FlushPolicy policy;
+  policy.max_bytes = 1 << 20;
+  policy.max_delay_ms = 1000000;
+  sync_appender->SetFlushPolicy(policy);
+  ring_appender = std::make_shared<FileLogAppender>("crash_ring.log", FileLogAppender::AsyncMode::RING_BUFFER);
+  logger->AddAppender(sync_appender);
+  logger->AddAppender(ring_appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  auto pid = fork();
+  if (pid == 0) {
+    LoggerManager::InstallCrashHandler();
+    for (int i = 0; i < 1000; i++) {
+      LINFO("crash") << "line " << i;
+    }
+    abort();
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  std::cout << "after a crash: killed by SIGABRT " << (WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT) << ", "
+            << count_lines("crash_sync.log") << " " << count_lines("crash_ring.log") << " (expect 1, 1000 1000)"
+            << std::endl;
+  LoggerManager::GetInstance()->DeleteLogger("crash");
+}
+
+// lines from concurrent threads stay whole, and a file gets no color codes
+void console_test() {
+  for (bool async : {false, true}) {
+    std::cout << std::flush;
+    int saved = dup(STDOUT_FILENO);
+    int fd = open("console.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    {
+      auto appender = std::make_shared<ConsoleLogAppender>(async);
+      appender->SetFormatter(std::make_shared<Formatter>("%p %m%n"));
+      auto logger = std::make_shared<Logger>("console");
+      logger->AddAppender(appender);
+      LoggerManager::GetInstance()->AddLogger(logger);
+      std::vector<std::thread> threads;
+      for (int t = 0; t < 4; t++) {
+        threads.emplace_back([t]() {
+          for (int i = 0; i < 1000; i++) {
+            LINFO("console") << "thread " << t << " line " << i << " " << std::string(100, 'a' + t);
+          }
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+      LoggerManager::GetInstance()->DeleteLogger("console");
+    }
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    std::ifstream file("console.log");
+    int lines = 0;
+    int whole = 0;
+    for (std::string line; std::getline(file, line); lines++) {
+      whole += line.size() > 100 && line.compare(0, 5, "INFO ") == 0 &&
+               line.find_first_not_of(line.back(), line.size() - 100) == std::string::npos;
+    }
+    std::cout << (async ? "async" : "sync") << " console lines: " << whole << " whole of " << lines
+              << " (expect 4000 of 4000)" << std::endl;
+  }
+}
+
+// taking the whole BlockDeque per batch instead of one line per pop
+void block_deque_batch_test() {
+  auto run = [](const char *name, bool batch) {
+    BlockDeque<std::string> deque;
+    std::string line(100, 'x');
+    constexpr int kLines = 200000;
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&]() {
+      std::string str;
+      std::deque<std::string> items;
+      while (bytes < kLines * line.size()) {
+        if (batch) {
+          deque.pop_all(items);
+          for (const auto &item : items) {
+            bytes += item.size();
+          }
+        } else {
+          deque.pop(str);
+          bytes += str.size();
+        }
+      }
+    });
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; t++) {
+      producers.emplace_back([&]() {
+        for (int i = 0; i < kLines / 4; i++) {
+          deque.push_back(line);
+        }
+      });
+    }
+    for (auto &t : producers) {
+      t.join();
+    }
+    consumer.join();
+    auto cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto mb = static_cast<double>(bytes) / (1 << 20);
+    std::cout << name << ": " << static_cast<int>(mb / cost) << " MB/s, "
+              << static_cast<int>((deque.lock_count() - kLines) / mb) << " consumer lock acquisitions per MB" << std::endl;
+  };
+  run("pop", false);
+  run("pop_all", true);
+}
+
 void rootlogger_test() {
   LRDEBUG << "debug";
   LRINFO << "info";
@@ -44,7 +535,32 @@ void rootlogger_test() {
   LRFATAL << "FATAL";
 }
 
-void formatlog_test() { FLDEBUG("root", "%d + %d = %d", 1, 1, 2); }
+struct Point {
+  int x;
+  int y;
+};
+std::ostream &operator<<(std::ostream &os, const Point &point) { return os << '(' << point.x << ", " << point.y << ')'; }
+
+struct Celsius {
+  double degrees;
+};
+template <>
+struct xac::arg_pack::ArgFormatter<Celsius> {
+  static void Format(std::streambuf &out, const Celsius &value) {
+    auto text = std::to_string(static_cast<int>(value.degrees)) + "C";
+    out.sputn(text.data(), static_cast<std::streamsize>(text.size()));
+  }
+};
+
+void formatlog_test() {
+  FLDEBUG("root", "%d + %d = %d", 1, 1, 2);
+  FLRWARN("%s", "FLR macros expand");
+  FMTRDEBUG("{} + {} = {}", 1, 1, 2);
+  static LogSite site{__FILE__, __LINE__, "{} {} {} {} {} {} {{}}", nullptr, LogLevel::Level::INFO, true};
+  LogEvent event(site, GetTimeNs(), 0, GetThreadId(), GetThreadName(), GetFiberId(), "root", LogLevel::Level::INFO);
+  event.CaptureBraces<6>(-1, 2.5, true, 'x', Point{1, 2}, Celsius{21.5});
+  std::cout << "braces: " << event.GetContent() << " (expect -1 2.5 true x (1, 2) 21C {})" << std::endl;
+}
 
 void formatter_test() {
   auto appender = std::make_shared<ConsoleLogAppender>();
@@ -55,6 +571,165 @@ void formatter_test() {
   LRDEBUG << "test new format";
 }
 
+// the format items and the compiled program must print the same text
+void time_test() {
+  // 2021-01-02 03:04:05.123456789 UTC, only the sub-second digits are independent of the time zone
+  uint64_t time = 1609556645123456789;
+  char buf[128];
+  auto len = FormatTime("%S.%L %f %N %%L", time, buf, sizeof(buf));
+  std::cout << "time: " << std::string_view(buf, len) << std::endl;
+  len = FormatTime("%S.%L", time + 1000000, buf, sizeof(buf));
+  std::cout << "next millisecond: " << std::string_view(buf, len) << std::endl;
+  // too long for the cache, printed whole rather than cut
+  std::string long_format(70, '-');
+  long_format += "%L";
+  len = FormatTime(long_format, time, buf, sizeof(buf));
+  std::cout << "long format: " << std::string_view(buf, len).substr(long_format.size() - 2) << " (expect 123)"
+            << std::endl;
+}
+
+void clock_test() {
+  for (auto source : {Clock::Source::REALTIME, Clock::Source::REALTIME_COARSE, Clock::Source::MONOTONIC,
+                      Clock::Source::TSC, Clock::Source::REALTIME}) {
+    bool usable = Clock::SetSource(source);
+    auto wall = GetTimeNs();
+    auto time = Clock::ToNs(Clock::Now());
+    auto diff = time > wall ? time - wall : wall - time;
+    std::cout << "clock " << source << ": usable " << usable << ", off by " << diff / 1000 << "us" << std::endl;
+  }
+  static constexpr LogSite site{__FILE__, __LINE__, nullptr};
+  std::string logger_name = "clock";
+  LogEvent event(site, Clock::Now(), LogEvent::kElapseFromTime, 1, GetThreadName(), 1, logger_name,
+                 LogLevel::Level::INFO);
+  LineBuffer line;
+  Formatter("%r ms since start").Format(line, LogLevel::Level::INFO, event);
+  std::cout << line.View() << std::endl;
+}
+
+void pattern_test() {
+  static constexpr LogSite site{__FILE__, __LINE__, nullptr};
+  std::string logger_name = "pattern";
+  LogEvent event(site, GetTimeNs(), 0, 1, GetThreadName(), 1, logger_name, LogLevel::Level::WARN);
+  event.GetStringStream() << "content";
+  bool same = true;
+  for (const auto *pattern : {kSimplePattern, kComplexPattern, "100%% %m%%", "%x %d{%H} %d{} %q{abc} %", "%d{%H:%M:%S.%L} %d{%f|%N|%%L}", "plain"}) {
+    Formatter formatter(pattern);
+    std::stringstream items;
+    LineBuffer program;
+    formatter.Format(items, LogLevel::Level::WARN, event);
+    formatter.Format(program, LogLevel::Level::WARN, event);
+    same = same && items.str() == program.View();
+  }
+  LineBuffer program;
+  LineBuffer static_program;
+  Formatter(kComplexPattern).Format(program, LogLevel::Level::WARN, event);
+  StaticFormatter<kComplexPattern>::Format(static_program, LogLevel::Level::WARN, event);
+  same = same && program.View() == static_program.View();
+  std::cout << "format items and programs agree: " << same << std::endl;
+}
+
+class CountAppender : public LogAppenderBase {
+ public:
+  int count = 0;
+
+ private:
+  void Log(LogLevel::Level, const LogEvent &) override { ++count; }
+};
+
+// a call site keeps its cached logger until the registry changes
+void handle_test() {
+  auto first = std::make_shared<CountAppender>();
+  auto second = std::make_shared<CountAppender>();
+  for (const auto &appender : {first, second}) {
+    auto logger = std::make_shared<Logger>("handle");
+    logger->AddAppender(appender);
+    LoggerManager::GetInstance()->DeleteLogger("handle");
+    LoggerManager::GetInstance()->AddLogger(logger);
+    for (int i = 0; i < 3; i++) {
+      LINFO("handle") << i;
+    }
+  }
+  LoggerManager::GetInstance()->DeleteLogger("handle");
+  std::cout << "events per logger generation: " << first->count << " and " << second->count << " (expect 3 and 3)"
+            << std::endl;
+}
+
+// dotted loggers inherit their parent's level and, when additive, its appenders
+void hierarchy_test() {
+  auto *manager = LoggerManager::GetInstance();
+  auto svc = std::make_shared<CountAppender>();
+  auto pool = std::make_shared<CountAppender>();
+  auto svc_logger = std::make_shared<Logger>("svc");
+  svc_logger->AddAppender(svc);
+  manager->AddLogger(svc_logger);
+  manager->GetLogger("svc.db.pool")->AddAppender(pool);
+  // creates "svc.db", which moves in between the two
+  manager->SetLevel("svc.db", LogLevel::Level::WARN);
+  std::cout << "parent of svc.db.pool: " << manager->GetLogger("svc.db.pool")->GetParent()->GetName()
+            << " (expect svc.db)" << std::endl;
+  LINFO("svc.db.pool") << "quiet";
+  LWARN("svc.db.pool") << "loud";
+  LINFO("svc") << "loud";
+  std::cout << "svc.db.pool enabled for INFO: " << manager->GetLogger("svc.db.pool")->IsEnabled(LogLevel::Level::INFO)
+            << " (expect 0)" << std::endl;
+  std::cout << "events at svc and svc.db.pool: " << svc->count << " and " << pool->count << " (expect 2 and 1)"
+            << std::endl;
+  manager->DeleteLogger("svc.db.pool");
+  manager->DeleteLogger("svc.db");
+  manager->DeleteLogger("svc");
+}
+
+// LogStream prints what a std::ostream would, manipulators and long content included
+void log_stream_test() {
+  LogStream stream;
+  std::ostringstream expected;
+  auto both = [&](const auto &value) {
+    stream << value;
+    expected << value;
+  };
+  both(-42);
+  both(' ');
+  both(3.14159265);
+  both(1e20);
+  both(std::string_view(" view "));
+  both(true);
+  both(Point{3, 4});
+  stream << std::hex << 255 << std::dec << ' ' << 1.0 / 3;
+  expected << std::hex << 255 << std::dec << ' ' << 1.0 / 3;
+  both(std::string(1000, 'x'));
+  std::cout << "log stream matches ostream: " << (stream.View() == expected.str()) << " (expect 1)" << std::endl;
+}
+
+// a single statement can be switched on and off without touching the logger's level
+void site_test() {
+  auto appender = std::make_shared<CountAppender>();
+  auto logger = std::make_shared<Logger>("site");
+  logger->AddAppender(appender);
+  logger->SetLevel(LogLevel::Level::INFO);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  uint32_t line = 0;
+  size_t matched = 0;
+  for (int i = 0; i < 3; i++) {
+    line = __LINE__ + 1;
+    LDEBUG("site") << i;
+    auto pattern = "main.cpp:" + std::to_string(line);
+    if (i == 0) {
+      matched = LogSite::SetState(pattern, LogSite::ON);
+    } else if (i == 1) {
+      LogSite::SetState(pattern, LogSite::OFF);
+    } else {
+      LogSite::SetState(pattern, LogSite::DEFAULT);
+    }
+  }
+  LoggerManager::GetInstance()->DeleteLogger("site");
+  for (const auto *site : LogSite::List()) {
+    if (site->line == line) {
+      std::cout << "site " << site->function << " " << LogLevel::ToString(site->level) << ": matched " << matched
+                << ", logged " << appender->count << " (expect site_test DEBUG: matched 1, logged 1)" << std::endl;
+    }
+  }
+}
+
 void createlogger_test() {
   // create a logger named new
   auto logger = std::make_shared<Logger>("new");
@@ -71,6 +746,194 @@ void createlogger_test() {
   LDEBUG("new") << "this is from new logger";
 }
 
+void level_test() {
+  auto logger = std::make_shared<Logger>("quiet");
+  auto appender = std::make_shared<ConsoleLogAppender>();
+  appender->SetLevel(LogLevel::Level::WARN);
+  logger->AddAppender(appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+
+  int evaluated = 0;
+  auto count = [&evaluated]() { return ++evaluated; };
+  LDEBUG("quiet") << "never evaluated " << count();
+  FLINFO("quiet", "never evaluated %d", count());
+  LWARN("quiet") << "evaluated " << count();
+  appender->SetLevel(LogLevel::Level::DEBUG);
+  LDEBUG("quiet") << "evaluated " << count();
+  std::cout << "arguments evaluated: " << evaluated << " (expect 2)" << std::endl;
+}
+
+void allocation_test() {
+  auto logger = std::make_shared<Logger>("alloc");
+  logger->AddAppender(std::make_shared<FileLogAppender>("alloc.log", true));
+  LoggerManager::GetInstance()->AddLogger(logger);
+  auto log = [](int i) {
+    LDEBUG("alloc") << "steady state " << i << ' ' << 3.14;
+    FLINFO("alloc", "%s %d", "printf style", i);
+  };
+  // the first statements fill the event pool, the line buffer and register the ring
+  for (int i = 0; i < 100; i++) {
+    log(i);
+  }
+  auto before = allocation_count;
+  for (int i = 0; i < 10000; i++) {
+    log(i);
+  }
+  auto allocations = allocation_count - before;
+  LoggerManager::GetInstance()->DeleteLogger("alloc");
+  std::cout << "heap allocations in steady state: " << allocations << " (expect 0)" << std::endl;
+}
+
+// the same statements through a sync and a DEFERRED appender must produce the same file
+void deferred_test() {
+  auto logger = std::make_shared<Logger>("deferred");
+  auto sync_appender = std::make_shared<FileLogAppender>("deferred_sync.log");
+  auto deferred_appender = std::make_shared<FileLogAppender>("deferred.log", FileLogAppender::AsyncMode::DEFERRED);
+  auto formatter = std::make_shared<Formatter>(Formatter::COMPLEXPATTERN);
+  sync_appender->SetFormatter(formatter);
+  deferred_appender->SetFormatter(formatter);
+  logger->AddAppender(sync_appender);
+  logger->AddAppender(deferred_appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  std::string name = "deferred";
+  for (int i = 0; i < 100; i++) {
+    FLINFO("deferred", "%d|%5u|%-8s|%.3f|%x|%c|%s|%%|%*d", -i, i, "str", i / 3.0, i, 'a' + i % 26, name, 4, i);
+    LWARN("deferred") << "streamed " << i;
+    FMTWARN("deferred", "{} {} {} {{{}}}", i, i / 4.0, Point{i, -i}, name);
+  }
+  LoggerManager::GetInstance()->DeleteLogger("deferred");
+  logger.reset();
+  deferred_appender.reset();
+  sync_appender.reset();
+  std::ifstream sync_file("deferred_sync.log");
+  std::ifstream deferred_file("deferred.log");
+  std::stringstream sync_content;
+  std::stringstream deferred_content;
+  sync_content << sync_file.rdbuf();
+  deferred_content << deferred_file.rdbuf();
+  std::cout << "deferred output matches sync output: " << (sync_content.str() == deferred_content.str()) << std::endl;
+}
+
+// key-value fields reach the JSON lines the same way on the sync, deferred and binary paths
+void kv_test() {
+  auto logger = std::make_shared<Logger>("kv");
+  auto sync_appender = std::make_shared<FileLogAppender>("kv_sync.log");
+  auto deferred_appender = std::make_shared<FileLogAppender>("kv.log", FileLogAppender::AsyncMode::DEFERRED);
+  auto binary_appender = std::make_shared<FileLogAppender>("kv.bin", FileLogAppender::AsyncMode::BINARY);
+  auto formatter = std::make_shared<Formatter>(Formatter::JSONPATTERN);
+  sync_appender->SetFormatter(formatter);
+  deferred_appender->SetFormatter(formatter);
+  logger->AddAppender(sync_appender);
+  logger->AddAppender(deferred_appender);
+  logger->AddAppender(binary_appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  for (int i = 0; i < 100; i++) {
+    LINFO("kv").kv("user", i).kv("ms", i / 4.0).kv("ok", i % 2 == 0).kv("note", "say \"hi\"\n") << "done " << i;
+  }
+  LoggerManager::GetInstance()->DeleteLogger("kv");
+  logger.reset();
+  sync_appender.reset();
+  deferred_appender.reset();
+  binary_appender.reset();
+  auto read = [](const char *name) {
+    std::ifstream file(name);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+  };
+  auto text = read("kv_sync.log");
+  std::ifstream binary_file("kv.bin", std::ios_base::binary);
+  binary_log::Reader reader(binary_file);
+  LineBuffer decoded;
+  while (const auto *event = reader.Next()) {
+    formatter->Format(decoded, event->GetLevel(), *event);
+  }
+  std::cout << "json: " << text.substr(text.find("\"level\"") - 1, text.find('\n') - text.find("\"level\"") + 1)
+            << std::endl;
+  std::cout << "json paths agree: " << (text == read("kv.log")) << " " << (text == decoded.View()) << " (expect 1 1)"
+            << std::endl;
+}
+
+// a BINARY file decoded with the appender's pattern must match the text output
+void binary_test() {
+  auto logger = std::make_shared<Logger>("binary");
+  auto text_appender = std::make_shared<FileLogAppender>("binary.txt", FileLogAppender::AsyncMode::DEFERRED);
+  auto binary_appender = std::make_shared<FileLogAppender>("binary.log", FileLogAppender::AsyncMode::BINARY);
+  logger->AddAppender(text_appender);
+  logger->AddAppender(binary_appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  for (int i = 0; i < 10000; i++) {
+    FLINFO("binary", "request %d served in %.2f ms by %s", i, i / 7.0, "worker");
+    FMTINFO("binary", "request {} done: {} {}", i, i % 2 == 0, 'x');
+    LDEBUG("binary") << "streamed " << i;
+  }
+  LoggerManager::GetInstance()->DeleteLogger("binary");
+  logger.reset();
+  text_appender.reset();
+  binary_appender.reset();
+
+  std::ifstream binary_file("binary.log", std::ios_base::binary);
+  binary_log::Reader reader(binary_file);
+  Formatter formatter(Formatter::SIMPLEPATTERN);
+  Formatter complex_formatter(Formatter::COMPLEXPATTERN);
+  std::stringstream decoded;
+  std::stringstream complex_text;
+  while (const auto *event = reader.Next()) {
+    formatter.Format(decoded, event->GetLevel(), *event);
+    complex_formatter.Format(complex_text, event->GetLevel(), *event);
+  }
+  std::ifstream text_file("binary.txt");
+  std::stringstream text;
+  text << text_file.rdbuf();
+  binary_file.clear();
+  binary_file.seekg(0, std::ios_base::end);
+  std::cout << "decoded binary matches text: " << (decoded.str() == text.str()) << ", " << text.str().size()
+            << " bytes as text, " << complex_text.str().size() << " with the complex pattern, " << binary_file.tellg()
+            << " bytes as binary" << std::endl;
+}
+
+// a rotated BINARY file and the one reopened after it decode on their own
+void binary_rotate_test() {
+  auto logger = std::make_shared<Logger>("rotate");
+  auto appender = std::make_shared<FileLogAppender>("rotate.log", FileLogAppender::AsyncMode::BINARY);
+  logger->AddAppender(appender);
+  LoggerManager::GetInstance()->AddLogger(logger);
+  auto log = [](int from, int to) {
+    for (int i = from; i < to; i++) {
+      FLINFO("rotate", "event %d", i);
+    }
+  };
+  log(0, 100);
+  appender->Flush();
+  rename("rotate.log", "rotate.1.log");
+  appender->Reopen();
+  log(100, 200);
+  // reopened without rotation, the file goes on with a second header
+  appender->Reopen();
+  log(200, 250);
+  LoggerManager::GetInstance()->DeleteLogger("rotate");
+  logger.reset();
+  appender.reset();
+  auto decode = [](const char *name) {
+    std::ifstream file(name, std::ios_base::binary);
+    binary_log::Reader reader(file);
+    std::string events;
+    while (const auto *event = reader.Next()) {
+      events += std::string(event->GetContent()) + ",";
+    }
+    return events;
+  };
+  auto expected = [](int from, int to) {
+    std::string events;
+    for (int i = from; i < to; i++) {
+      events += "event " + std::to_string(i) + ",";
+    }
+    return events;
+  };
+  std::cout << "rotated binary decodes: " << (decode("rotate.1.log") == expected(0, 100)) << " "
+            << (decode("rotate.log") == expected(100, 250)) << " (expect 1 1)" << std::endl;
+}
+
 auto main() -> int {
   LoggerManager::Instance();
 
@@ -80,10 +943,58 @@ auto main() -> int {
 
   createlogger_test();
 
+  handle_test();
+
+  hierarchy_test();
+
+  site_test();
+
+  log_stream_test();
+
   formatter_test();
 
+  pattern_test();
+
+  time_test();
+
+  clock_test();
+
+  level_test();
+
+  allocation_test();
+
+  deferred_test();
+
+  binary_test();
+
+  binary_rotate_test();
+
+  kv_test();
+
   filelog_test();
 
+  flush_policy_test();
+
+  filelog_mode_test();
+
+  block_deque_batch_test();
+
+  console_test();
+
+  stats_test();
+
+  backend_pool_test();
+
+  rate_limit_test();
+
+  dedup_test();
+
+  shutdown_test();
+
+  overflow_test();
+
+  oversize_test();
+
   LoggerManager::DestroyInstance();
   return 0;
 }
@@ -0,0 +1,44 @@
+// Turn a binary log written by FileLogAppender in BINARY mode back into text.
+//
+// usage: easylog-decode <file> [pattern]
+// pattern is a Formatter pattern, or COMPLEX / SIMPLE for the built-in ones
+#include <fstream>
+#include <iostream>
+#include "binary_log.h"
+using namespace xac;
+
+auto main(int argc, char **argv) -> int {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <file> [pattern | COMPLEX | SIMPLE]" << std::endl;
+    return 1;
+  }
+  std::string pattern = argc > 2 ? argv[2] : "SIMPLE";
+  if (pattern == "COMPLEX") {
+    pattern = Formatter::COMPLEXPATTERN;
+  } else if (pattern == "SIMPLE") {
+    pattern = Formatter::SIMPLEPATTERN;
+  }
+  std::ifstream in(argv[1], std::ios_base::binary);
+  if (!in.is_open()) {
+    std::cerr << "can not open " << argv[1] << std::endl;
+    return 1;
+  }
+  binary_log::Reader reader(in);
+  if (!reader.Good()) {
+    std::cerr << argv[1] << " is not an easylog binary file" << std::endl;
+    return 1;
+  }
+  Formatter formatter(pattern);
+  LineBuffer line;
+  while (const auto *event = reader.Next()) {
+    formatter.Format(line, event->GetLevel(), *event);
+    auto text = line.View();
+    std::cout.write(text.data(), static_cast<std::streamsize>(text.size()));
+    line.Clear();
+  }
+  if (!in.eof()) {
+    std::cerr << "stopped at a corrupt record" << std::endl;
+    return 1;
+  }
+  return 0;
+}